@@ -1,5 +1,6 @@
 #include "devices/intq.h"
 #include <debug.h>
+#include <string.h>
 #include "threads/thread.h"
 
 static int next (int pos);
@@ -74,6 +75,34 @@ intq_putc (struct intq *q, uint8_t byte)
   signal (q, &q->not_empty);
 }
 
+/* Adds up to CNT bytes from BUF to the end of Q, as many as fit
+   without waiting, and returns the number added. */
+size_t
+intq_putn (struct intq *q, const uint8_t *buf, size_t cnt) 
+{
+  size_t done = 0;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  while (done < cnt && !intq_full (q)) 
+    {
+      /* Copy up to the end of the buffer, or up to the byte
+         before the tail, whichever comes first. */
+      int end = (q->tail > q->head ? q->tail - 1
+                 : q->tail > 0 ? INTQ_BUFSIZE
+                 : INTQ_BUFSIZE - 1);
+      size_t chunk = end - q->head;
+      if (chunk > cnt - done)
+        chunk = cnt - done;
+
+      memcpy (q->buf + q->head, buf + done, chunk);
+      q->head = (q->head + chunk) % INTQ_BUFSIZE;
+      done += chunk;
+    }
+  if (done > 0)
+    signal (q, &q->not_empty);
+  return done;
+}
+
 /* Returns the position after POS within an intq. */
 static int
 next (int pos) 
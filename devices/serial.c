@@ -129,6 +129,48 @@ serial_putc (uint8_t byte)
   intr_set_level (old_level);
 }
 
+/* Sends the N bytes in BUFFER to the serial port.  Like calling
+   serial_putc() on each byte, but in queued mode copies as many
+   bytes into the transmit queue as fit each time interrupts are
+   disabled. */
+void
+serial_write (const void *buffer, size_t n) 
+{
+  const uint8_t *p = buffer;
+
+  while (n > 0) 
+    {
+      enum intr_level old_level = intr_disable ();
+      size_t done;
+
+      if (mode != QUEUE) 
+        {
+          if (mode == UNINIT)
+            init_poll ();
+          putc_poll (*p);
+          done = 1;
+        }
+      else 
+        {
+          done = intq_putn (&txq, p, n);
+          if (done == 0) 
+            {
+              /* The queue is full.  Make room the same way as
+                 serial_putc(). */
+              if (old_level == INTR_OFF)
+                putc_poll (intq_getc (&txq));
+              intq_putc (&txq, *p);
+              done = 1;
+            }
+          write_ier ();
+        }
+
+      intr_set_level (old_level);
+      p += done;
+      n -= done;
+    }
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void
@@ -218,11 +218,12 @@ timer_print_stats (void)
 
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
   ticks++;
   checkSleepingList();
-  thread_tick ();
+  /* User code runs at privilege level 3. */
+  thread_tick ((args->cs & 3) == 3);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
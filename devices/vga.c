@@ -26,6 +26,7 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+static void putc_nocursor (int c, enum intr_level);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -46,6 +47,10 @@ init (void)
     }
 }
 
+/* Number of bytes vga_write() writes each time it disables
+   interrupts. */
+#define WRITE_CHUNK 256
+
 /* Writes C to the VGA text display, interpreting control
    characters in the conventional ways.  */
 void
@@ -56,7 +61,64 @@ vga_putc (int c)
   enum intr_level old_level = intr_disable ();
 
   init ();
-  
+  putc_nocursor (c, old_level);
+
+  /* Update cursor position. */
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes the N bytes in BUFFER to the VGA text display, like
+   calling vga_putc() on each one, but storing runs of ordinary
+   characters straight into the framebuffer and moving the
+   hardware cursor only once per chunk. */
+void
+vga_write (const char *buffer, size_t n)
+{
+  while (n > 0)
+    {
+      enum intr_level old_level = intr_disable ();
+      size_t chunk = n < WRITE_CHUNK ? n : WRITE_CHUNK;
+      size_t i = 0;
+
+      init ();
+      while (i < chunk)
+        {
+          /* Copy the run of printable characters that fits on
+             the current row. */
+          size_t run = 0;
+          while (i + run < chunk && cx + run < COL_CNT
+                 && (uint8_t) buffer[i + run] >= ' ')
+            {
+              fb[cy][cx + run][0] = buffer[i + run];
+              fb[cy][cx + run][1] = GRAY_ON_BLACK;
+              run++;
+            }
+          if (run > 0)
+            {
+              i += run;
+              cx += run;
+              if (cx >= COL_CNT)
+                newline ();
+            }
+          else
+            putc_nocursor (buffer[i++], old_level);
+        }
+      move_cursor ();
+
+      intr_set_level (old_level);
+      buffer += chunk;
+      n -= chunk;
+    }
+}
+
+/* Writes C to the VGA text display without updating the hardware
+   cursor.  Interrupts must be off; OLD_LEVEL is the level to
+   restore while beeping. */
+static void
+putc_nocursor (int c, enum intr_level old_level)
+{
   switch (c) 
     {
     case '\n':
@@ -95,13 +157,8 @@ vga_putc (int c)
         newline ();
       break;
     }
-
-  /* Update cursor position. */
-  move_cursor ();
-
-  intr_set_level (old_level);
 }
-
+
 /* Clears the screen and moves the cursor to the upper left. */
 static void
 cls (void)
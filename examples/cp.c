@@ -9,6 +9,7 @@ int
 main (int argc, char *argv[]) 
 {
   int in_fd, out_fd;
+  int size;
 
   if (argc != 3) 
     {
@@ -37,18 +38,12 @@ main (int argc, char *argv[])
       return EXIT_FAILURE;
     }
 
-  /* Copy data. */
-  for (;;) 
+  /* Copy data, inside the kernel. */
+  size = filesize (in_fd);
+  if (copy_file_range (in_fd, out_fd, size) != size) 
     {
-      char buffer[1024];
-      int bytes_read = read (in_fd, buffer, sizeof buffer);
-      if (bytes_read == 0)
-        break;
-      if (write (out_fd, buffer, bytes_read) != bytes_read) 
-        {
-          printf ("%s: write failed\n", argv[2]);
-          return EXIT_FAILURE;
-        }
+      printf ("%s: write failed\n", argv[2]);
+      return EXIT_FAILURE;
     }
 
   return EXIT_SUCCESS;
@@ -0,0 +1,41 @@
+/* sysstats.c
+
+   Prints how many times each system call has been made, and
+   how long the calls took, for all processes together.  If "-s"
+   is given, prints this process's own statistics instead, which
+   mostly shows the cost of the sysstats() call itself. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include <syscall-names.h>
+#include <syscall-nr.h>
+
+int
+main (int argc, char *argv[])
+{
+  static struct sysstat stats[SYS_CNT];
+  bool global = !(argc > 1 && !strcmp (argv[1], "-s"));
+  int cnt, i, j;
+
+  cnt = sysstats (global, stats, SYS_CNT);
+  if (cnt > SYS_CNT)
+    cnt = SYS_CNT;
+
+  printf ("%-15s %8s %12s  histogram (bucket I: under %d << I cycles)\n",
+          "call", "count", "avg cycles", 1 << (SYSSTAT_SHIFT + 1));
+  for (i = 0; i < cnt; i++)
+    {
+      const struct sysstat *st = &stats[i];
+      if (st->count == 0)
+        continue;
+
+      printf ("%-15s %8u %12llu ",
+              syscall_names[i] != NULL ? syscall_names[i] : "?",
+              st->count, st->cycles / st->count);
+      for (j = 0; j < SYSSTAT_BUCKETS; j++)
+        printf (" %u", st->hist[j]);
+      printf ("\n");
+    }
+  return EXIT_SUCCESS;
+}
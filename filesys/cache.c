@@ -5,16 +5,26 @@
 #include "devices/block.h"
 #include "threads/synch.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include <list.h>
 #include "devices/timer.h"
 #include "threads/thread.h"
 
+/* The cache holds at most CACHE_SIZE sectors. */
+#define CACHE_SIZE 64
+
+/* cache_lock guards the list, the count and each entry's sector
+   and use count, but is never held across disk I/O: an entry is
+   read in under its own io_lock, and written back while pinned by
+   a use count so that it cannot be freed or reused meanwhile. */
 struct list cache_list;
 int cache_size;
 struct lock cache_lock;
 
 struct cache *clock_cache;
 
+static struct cache *lookup_cache (block_sector_t sector);
+
 void init_cache ()
 {
 	list_init (&cache_list);
@@ -23,24 +33,73 @@ void init_cache ()
 	thread_create ("write_behind", PRI_DEFAULT, write_behind, NULL);
 }
 
-struct cache *get_cache (block_sector_t sector)
+/* Returns the entry for SECTOR, or a null pointer if it is not
+   cached.  The caller must hold cache_lock. */
+static struct cache *lookup_cache (block_sector_t sector)
 {
-	lock_acquire (&cache_lock);
 	struct list_elem *e;
-	struct cache *c;
-	c = NULL;
-	for(e = list_begin (&cache_list); e != list_end (&cache_list); e = list_next (e))
+	for (e = list_begin (&cache_list); e != list_end (&cache_list); e = list_next (e))
 	{
-		c = list_entry (e, struct cache, elem);
+		struct cache *c = list_entry (e, struct cache, elem);
 		if (c->sector == sector)
+			return c;
+	}
+	return NULL;
+}
+
+/* Sector number given to an entry that discard_cache() could not
+   free because it was still in use, so that lookups pass over it
+   until eviction frees it. */
+#define NO_SECTOR ((block_sector_t) -1)
+
+static void load_cache (struct cache *c, bool read);
+
+/* Returns the cache entry for SECTOR, reading it from disk if it
+   is not cached, with a reference that the caller must drop with
+   release_cache().  Threads that miss on different sectors read
+   them in parallel. */
+struct cache *get_cache (block_sector_t sector)
+{
+	struct cache *c = pin_cache (sector);
+	load_cache (c, true);
+	return c;
+}
+
+/* Like get_cache(), but for a caller about to overwrite all of
+   SECTOR: on a miss, skips reading the old contents from disk.
+   The entry's data is garbage until the caller fills it in. */
+struct cache *get_cache_overwrite (block_sector_t sector)
+{
+	struct cache *c = pin_cache (sector);
+	load_cache (c, false);
+	return c;
+}
+
+/* Returns the cache entry for SECTOR with a reference, like
+   get_cache(), but without reading SECTOR in or waiting for
+   another thread to: the caller must call fill_cache() before
+   touching the entry's data.  Lets a caller pin a sector under a
+   lock that it does not want to hold across the read.  The
+   reference keeps the entry's data that of SECTOR even if
+   SECTOR is discarded meanwhile. */
+struct cache *pin_cache (block_sector_t sector)
+{
+	struct cache *c;
+	lock_acquire (&cache_lock);
+	while (true)
+	{
+		c = lookup_cache (sector);
+		if (c != NULL)
 		{
 			c->used++;
 			lock_release (&cache_lock);
 			return c;
 		}
-	}
-	if (cache_size == 64)
+		if (cache_size < CACHE_SIZE)
+			break;
+		/* Eviction may drop cache_lock, so look again after. */
 		evict_cache ();
+	}
 	cache_size++;
 	c = malloc (sizeof (struct cache));
 	if (c == NULL)
@@ -50,10 +109,11 @@ struct cache *get_cache (block_sector_t sector)
 		return NULL;
 	}
 	c->sector = sector;
-	block_read (fs_device, c->sector, &c->data);
 	c->accessed = true;
 	c->dirty = false;
 	c->used = 1;
+	lock_init (&c->io_lock);
+	lock_acquire (&c->io_lock);
 	list_push_back (&cache_list, &c->elem);
 	if(cache_size == 1)
 		clock_cache = c;
@@ -61,6 +121,89 @@ struct cache *get_cache (block_sector_t sector)
 	return c;
 }
 
+/* Reads in the data of C, pinned by pin_cache(), if it is not
+   already there. */
+void fill_cache (struct cache *c)
+{
+	load_cache (c, true);
+}
+
+/* Finishes pin_cache(): if this thread missed on C, and so holds
+   its io_lock, reads its sector in only if READ; otherwise waits
+   for the thread that is reading it in, if any. */
+static void load_cache (struct cache *c, bool read)
+{
+	if (lock_held_by_current_thread (&c->io_lock))
+	{
+		if (read)
+			block_read (fs_device, c->sector, &c->data);
+	}
+	else
+		lock_acquire (&c->io_lock);
+	lock_release (&c->io_lock);
+}
+
+/* Writes C back to disk under its io_lock but without holding
+   cache_lock, which the caller must hold on entry and gets back
+   on return.  io_lock is taken before cache_lock is dropped, as
+   on a miss, so that discard_cache() cannot slip in between and
+   free the sector under the write. */
+static void write_back (struct cache *c)
+{
+	c->used++;
+	c->dirty = false;
+	lock_acquire (&c->io_lock);
+	lock_release (&cache_lock);
+	block_write (fs_device, c->sector, &c->data);
+	lock_release (&c->io_lock);
+	lock_acquire (&cache_lock);
+	c->used--;
+}
+
+/* Drops the reference to C taken by get_cache(), making it a
+   candidate for eviction again once no one else is using it. */
+void release_cache (struct cache *c)
+{
+	lock_acquire (&cache_lock);
+	c->used--;
+	lock_release (&cache_lock);
+}
+
+/* Drops any cached copy of SECTOR without writing it back, for
+   use when SECTOR is freed and its contents no longer matter.
+   Otherwise a stale copy would shadow whatever is later written
+   to the sector behind the cache's back. */
+void discard_cache (block_sector_t sector)
+{
+	struct cache *c;
+	lock_acquire (&cache_lock);
+	c = lookup_cache (sector);
+	if (c != NULL)
+	{
+		/* Let any write-back in progress finish first, so that it
+		   cannot land on top of the sector's next contents. */
+		c->dirty = false;
+		c->used++;
+		lock_release (&cache_lock);
+		lock_acquire (&c->io_lock);
+		lock_release (&c->io_lock);
+		lock_acquire (&cache_lock);
+		if (--c->used == 0)
+		{
+			if (clock_cache == c)
+				clock_cache = NULL;
+			list_remove (&c->elem);
+			free (c);
+			cache_size--;
+		}
+		else
+			/* A reader that pinned it before SECTOR was freed may
+			   still copy out of it; eviction frees it after. */
+			c->sector = NO_SECTOR;
+	}
+	lock_release (&cache_lock);
+}
+
 /*struct cache *make_cache (block_sector_t sector)
 {
 	lock_acquire (&cache_lock);
@@ -88,6 +231,10 @@ struct cache *get_cache (block_sector_t sector)
 	return c;
 }*/
 
+/* Frees one unused entry, choosing it by the clock algorithm.
+   If the entry chosen is dirty, writes it back instead and
+   returns, dropping cache_lock meanwhile, so the caller must
+   recheck the cache.  The caller must hold cache_lock. */
 void evict_cache ()
 {
 	struct list_elem *e;
@@ -100,7 +247,7 @@ void evict_cache ()
 	{
 		c = list_entry (e, struct cache, elem);
 		e = list_next (e);
-		if (e = list_end (&cache_list))
+		if (e == list_end (&cache_list))
 			e = list_begin (&cache_list);
 		if (c->used)
 		{
@@ -109,17 +256,21 @@ void evict_cache ()
 		{
 			c->accessed = false;
 		}
+		else if (c->dirty)
+		{
+			clock_cache = c;
+			write_back (c);
+			return;
+		}
 		else
 		{
-			if (c->dirty)
-			{
-				block_write (fs_device, c->sector, &c->data);
-			}
-				clock_cache = list_entry (e, struct cache, elem);
-				list_remove (&c->elem);
-				free (c);
-				cache_size--;
-				return;			
+			clock_cache = list_entry (e, struct cache, elem);
+			if (clock_cache == c)
+				clock_cache = NULL;
+			list_remove (&c->elem);
+			free (c);
+			cache_size--;
+			return;
 		}
 	}
 }
@@ -146,20 +297,15 @@ void write_behind ()
 	while (true)
 	{
 		timer_sleep (600);
+		free_map_sync ();
 		lock_acquire (&cache_lock);
 		for (e = list_begin (&cache_list); e != list_end (&cache_list); e = list_next (e))
 		{
+			/* write_back() pins C, so E stays valid. */
 			c = list_entry (e, struct cache, elem);
 			if (c->dirty)
-			{
-				block_write (fs_device, c->sector, &c->data);
-				c->dirty = false;
-			}
-				
+				write_back (c);
 		}
 		lock_release (&cache_lock);
 	}
 }
-
-
-
@@ -1,5 +1,6 @@
 #include "devices/block.h"
 #include <list.h>
+#include "threads/synch.h"
 
 struct cache
 {
@@ -8,10 +9,17 @@ struct cache
 	bool accessed;
 	bool dirty;
 	int used;
+	struct lock io_lock;	/* Held while the sector is read in. */
 	struct list_elem elem;
 };
 
+void init_cache (void);
 struct cache *get_cache (block_sector_t sector);
+struct cache *get_cache_overwrite (block_sector_t sector);
+struct cache *pin_cache (block_sector_t sector);
+void fill_cache (struct cache *c);
+void release_cache (struct cache *c);
+void discard_cache (block_sector_t sector);
 //struct cache *make_cache (block_sector_t sector);
 void evict_cache (void);
 void close_cache (void);
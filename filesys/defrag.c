@@ -0,0 +1,90 @@
+#include "filesys/defrag.h"
+#include <stdio.h>
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "threads/thread.h"
+
+/* Timer ticks between passes of the background defragmenter. */
+#define DEFRAG_INTERVAL (30 * TIMER_FREQ)
+
+/* Deepest directory nesting that a pass descends into, which
+   bounds the defragmenter's use of its kernel stack. */
+#define DEFRAG_MAX_DEPTH 16
+
+static void defrag_thread (void *aux);
+static void defrag_dir (struct dir *, int depth);
+
+/* Starts a low-priority kernel thread that periodically walks the
+   whole directory tree and makes each fragmented file
+   contiguous. */
+void
+defrag_init (void)
+{
+  thread_create ("defrag", PRI_MIN, defrag_thread, NULL);
+}
+
+/* Moves INODE's data into a single run of sectors and prints how
+   many fragments it was in before and after, labeled with NAME.
+   Returns true if its data is now contiguous. */
+bool
+defrag_inode (struct inode *inode, const char *name)
+{
+  int before = inode_fragments (inode);
+  bool success = inode_defrag (inode);
+
+  printf ("%s: %d fragments before, %d after\n",
+          name, before, inode_fragments (inode));
+  return success;
+}
+
+/* Background defragmenter. */
+static void
+defrag_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct dir *root;
+
+      timer_sleep (DEFRAG_INTERVAL);
+      root = dir_open_root ();
+      if (root != NULL)
+        {
+          defrag_dir (root, 0);
+          dir_close (root);
+        }
+    }
+}
+
+/* Defragments every fragmented file in DIR, which is DEPTH levels
+   below the root, and in its subdirectories. */
+static void
+defrag_dir (struct dir *dir, int depth)
+{
+  char name[NAME_MAX + 1];
+  struct inode *inode;
+
+  while (dir_readdir (dir, name))
+    {
+      if (!dir_lookup (dir, name, &inode))
+        continue;
+
+      if (!inode_isdir (inode))
+        {
+          if (inode_fragments (inode) > 1)
+            defrag_inode (inode, name);
+          inode_close (inode);
+        }
+      else if (depth < DEFRAG_MAX_DEPTH)
+        {
+          struct dir *child = dir_open (inode);
+          if (child != NULL)
+            {
+              defrag_dir (child, depth + 1);
+              dir_close (child);
+            }
+        }
+      else
+        inode_close (inode);
+    }
+}
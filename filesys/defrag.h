@@ -0,0 +1,11 @@
+#ifndef FILESYS_DEFRAG_H
+#define FILESYS_DEFRAG_H
+
+#include <stdbool.h>
+
+struct inode;
+
+void defrag_init (void);
+bool defrag_inode (struct inode *, const char *name);
+
+#endif /* filesys/defrag.h */
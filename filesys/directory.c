@@ -86,7 +86,8 @@ dir_get_inode (struct dir *dir)
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   The caller must hold DIR's inode lock. */
 static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
@@ -123,10 +124,12 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  inode_lock (dir->inode);
   if (lookup (dir, name, &e, NULL))
     *inode = inode_open (e.inode_sector);
   else
     *inode = NULL;
+  inode_unlock (dir->inode);
 
   return *inode != NULL;
 }
@@ -151,12 +154,14 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  inode_lock (dir->inode);
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
   if(!inode_set_parent(inode_sector, inode_get_inumber(dir_get_inode(dir))))
-	return false;
+	goto done;
 
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
@@ -177,6 +182,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
+  inode_unlock (dir->inode);
   return success;
 }
 
@@ -197,6 +203,8 @@ dir_remove (struct dir *dir, const char *name)
  if(name == "." || name == "..")
 	return false;
 
+  inode_lock (dir->inode);
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -206,30 +214,36 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
   
-  /* Checking Directory is available to delete */
+  /* Checking Directory is available to delete.  The child's lock
+     is taken after the parent's, so nobody can add an entry to it
+     between the emptiness check and its removal. */
   if(inode_isdir(inode))
   {
+	inode_lock (inode);
 	if(inode_get_cnt(inode)>=2)
-		goto done;
+		goto done_child;
 
 	struct dir_entry e;
 	off_t offset;
-	int cnt = 0;
 	for(offset = 0; inode_read_at(inode, &e, sizeof e, offset); offset += sizeof e)
 	{
 		if(e.in_use)
-			goto done;
+			goto done_child;
 	}
   }
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
-    goto done;
+    goto done_child;
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
+ done_child:
+  if (inode_isdir (inode))
+    inode_unlock (inode);
  done:
+  inode_unlock (dir->inode);
   inode_close (inode);
   return success;
 }
@@ -241,15 +255,19 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool success = false;
 
+  inode_lock (dir->inode);
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          success = true;
+          break;
         } 
     }
-  return false;
+  inode_unlock (dir->inode);
+  return success;
 }
@@ -8,6 +8,9 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/cache.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -38,10 +41,18 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
-	close_cache ();
+#ifdef USERPROG
+  exec_cache_flush ();
+#endif
   free_map_close ();
+  close_cache ();
 }
 
+/* Opens the directory that contains the last component of NAME.
+   Each component is looked up under its parent directory's lock,
+   which is dropped before the child is searched in turn, so a walk
+   only ever holds one directory lock and always takes them in
+   parent-before-child order. */
 struct dir* parse_dir(const char* name)
 {
 	if(!strlen(name))
@@ -55,10 +66,9 @@ struct dir* parse_dir(const char* name)
 	strlcpy(copy_name, name, strlen(name)+1);
 
 	//In case of absolute address or root directory
-	if(copy_name[0] == '/' || thread_current()->cudir == NULL)
+	dir = copy_name[0] == '/' ? NULL : process_reopen_cwd();
+	if(dir == NULL)
 		dir = dir_open_root();
-	else
-		dir = dir_reopen(thread_current()->cudir);			
 
 	ptoken = strtok_r(copy_name, "/", &save_ptr);
 	for(token = strtok_r(NULL, "/",&save_ptr); token != NULL; token = strtok_r(NULL, "/", &save_ptr))
@@ -137,7 +147,8 @@ filesys_create (const char *name, off_t initial_size, bool isdir)
 		return false;
 	
 	bool success = (dir != NULL
-			&& free_map_allocate(1, &inode_sector)
+			&& free_map_allocate_near(1, inode_get_inumber(dir_get_inode(dir)),
+						  &inode_sector)
 			&& inode_create (inode_sector, initial_size, isdir)
 			&& dir_add (dir, file_name, inode_sector));
 	if(!success && inode_sector != 0)
@@ -237,6 +248,10 @@ filesys_remove (const char *name)
   bool success = dir != NULL && dir_remove (dir, file_name);
   dir_close (dir); 
   free(file_name);
+#ifdef USERPROG
+  if (success)
+    exec_cache_drop_removed ();
+#endif
   return success;
 }
 
@@ -1,12 +1,47 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <limits.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Protects free_map and its file. */
+
+/* The in-memory free map is authoritative.  Allocations and
+   releases only mark the sectors of the free map file that hold
+   the changed bits; free_map_sync() writes those sectors back
+   through the buffer cache. */
+static struct bitmap *dirty_map;     /* One bit per free map sector. */
+
+static void mark_dirty (block_sector_t, size_t);
+static void sync_locked (void);
+
+/* The disk is divided into allocation groups of GROUP_SECTORS
+   sectors.  Each group keeps a summary of its free space so that
+   allocation can skip full or fragmented groups without looking
+   at their bits, and so that a request can be served from the
+   group that holds the sectors it should be near. */
+#define GROUP_SECTORS 512
+
+struct alloc_group
+  {
+    size_t free_cnt;            /* Number of free sectors. */
+    size_t max_run;             /* Longest run of free sectors. */
+  };
+
+static struct alloc_group *groups;   /* Per-group summaries. */
+static size_t group_cnt;             /* Number of groups. */
+
+static void group_update (size_t);
+static void groups_update (block_sector_t, size_t);
+static void groups_rebuild (void);
+static size_t group_walk (size_t, size_t, block_sector_t);
 
 /* Initializes the free map. */
 void
@@ -17,24 +52,64 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                           BLOCK_SECTOR_SIZE));
+  if (dirty_map == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  groups = calloc (group_cnt, sizeof *groups);
+  if (groups == NULL)
+    PANIC ("allocation group creation failed");
+  groups_rebuild ();
+  lock_init (&free_map_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (cnt, 0, sectorp);
+}
+
+/* Like free_map_allocate(), but places the CNT sectors as close
+   as possible to sector HINT: in HINT's allocation group if one
+   of its free runs is long enough, preferring the first run at
+   or after HINT, otherwise in the best-fitting run of the
+   nearest following group that can hold them. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t hint,
+                        block_sector_t *sectorp)
+{
+  block_sector_t sector = BITMAP_ERROR;
+  size_t first, i;
+
+  lock_acquire (&free_map_lock);
+  if (hint >= bitmap_size (free_map))
+    hint = 0;
+  first = hint / GROUP_SECTORS;
+  if (cnt <= GROUP_SECTORS)
+    for (i = 0; i < group_cnt && sector == BITMAP_ERROR; i++)
+      {
+        size_t g = (first + i) % group_cnt;
+        if (groups[g].max_run >= cnt)
+          sector = group_walk (g, cnt, i == 0 ? hint : BITMAP_ERROR);
+      }
+
+  /* Runs that straddle group boundaries are not tracked in the
+     summaries, so fall back to a full scan before giving up. */
+  if (sector == BITMAP_ERROR)
+    sector = bitmap_scan (free_map, 0, cnt, false);
+
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      mark_dirty (sector, cnt);
+      groups_update (sector, cnt);
     }
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
@@ -44,9 +119,22 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+  groups_update (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Writes the sectors of the free map file whose bits changed
+   since the last sync through the buffer cache. */
+void
+free_map_sync (void)
+{
+  lock_acquire (&free_map_lock);
+  sync_locked ();
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,13 +146,19 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  bitmap_set_all (dirty_map, false);
+  groups_rebuild ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  lock_acquire (&free_map_lock);
+  sync_locked ();
   file_close (free_map_file);
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -82,4 +176,126 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (dirty_map, false);
+}
+
+/* Marks the free map sectors holding the bits for CNT sectors
+   starting at SECTOR as needing to be written back. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first, last;
+
+  if (cnt == 0)
+    return;
+  first = sector / CHAR_BIT / BLOCK_SECTOR_SIZE;
+  last = (sector + cnt - 1) / CHAR_BIT / BLOCK_SECTOR_SIZE;
+  bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
+
+/* Writes every dirty free map sector to the free map file.
+   Must be called with free_map_lock held.  A sector that fails
+   to write stays dirty and is retried by the next sync. */
+static void
+sync_locked (void)
+{
+  size_t idx;
+
+  if (free_map_file == NULL)
+    return;
+  for (idx = bitmap_scan (dirty_map, 0, 1, true); idx != BITMAP_ERROR;
+       idx = bitmap_scan (dirty_map, idx + 1, 1, true))
+    {
+      if (bitmap_write_part (free_map, free_map_file,
+                             idx * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+        bitmap_reset (dirty_map, idx);
+    }
+}
+
+/* Returns the first sector of allocation group G and stores the
+   sector just past its end into *END. */
+static block_sector_t
+group_bounds (size_t g, block_sector_t *end)
+{
+  block_sector_t start = g * GROUP_SECTORS;
+  *end = start + GROUP_SECTORS;
+  if (*end > bitmap_size (free_map))
+    *end = bitmap_size (free_map);
+  return start;
+}
+
+/* Walks the free runs of group G, finding the ends of each with
+   bitmap_next() a word of bits at a time.  Recomputes the group's
+   summary and, if CNT is nonzero, returns the start of the run
+   in which to place CNT sectors: the first run that starts at or
+   after sector HINT and holds them, or failing that the smallest
+   run that holds them.  Returns BITMAP_ERROR if no run fits. */
+static size_t
+group_walk (size_t g, size_t cnt, block_sector_t hint)
+{
+  block_sector_t end, i;
+  block_sector_t start = group_bounds (g, &end);
+  size_t best = BITMAP_ERROR, best_len = SIZE_MAX;
+  size_t near = BITMAP_ERROR;
+
+  groups[g].free_cnt = 0;
+  groups[g].max_run = 0;
+  for (i = start; i < end; )
+    {
+      block_sector_t run;
+      size_t len;
+
+      run = bitmap_next (free_map, i, false);
+      if (run >= end)
+        break;
+      i = bitmap_next (free_map, run, true);
+      if (i > end)
+        i = end;
+      len = i - run;
+
+      groups[g].free_cnt += len;
+      if (len > groups[g].max_run)
+        groups[g].max_run = len;
+      if (cnt == 0 || len < cnt)
+        continue;
+      if (near == BITMAP_ERROR && hint != BITMAP_ERROR && i > hint)
+        near = run >= hint ? run : (i - hint >= cnt ? hint : BITMAP_ERROR);
+      if (len < best_len)
+        {
+          best = run;
+          best_len = len;
+        }
+    }
+  return near != BITMAP_ERROR ? near : best;
+}
+
+/* Recomputes the summary of group G. */
+static void
+group_update (size_t g)
+{
+  group_walk (g, 0, BITMAP_ERROR);
+}
+
+/* Recomputes the summaries of the groups that contain any of the
+   CNT sectors starting at SECTOR. */
+static void
+groups_update (block_sector_t sector, size_t cnt)
+{
+  size_t g;
+
+  if (cnt == 0)
+    return;
+  for (g = sector / GROUP_SECTORS; g <= (sector + cnt - 1) / GROUP_SECTORS;
+       g++)
+    group_update (g);
+}
+
+/* Recomputes the summaries of all groups from the free map. */
+static void
+groups_rebuild (void)
+{
+  size_t g;
+
+  for (g = 0; g < group_cnt; g++)
+    group_update (g);
 }
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ustar.h>
+#include "filesys/defrag.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -220,3 +221,20 @@ fsutil_append (char **argv)
   file_close (src);
   free (buffer);
 }
+
+/* Moves the data of file ARGV[1] into one contiguous run of
+   sectors, reporting its fragmentation before and after. */
+void
+fsutil_defrag (char **argv)
+{
+  const char *file_name = argv[1];
+  struct file *file;
+
+  printf ("Defragmenting '%s'...\n", file_name);
+  file = filesys_open (file_name);
+  if (file == NULL)
+    PANIC ("%s: open failed", file_name);
+  if (!defrag_inode (file_get_inode (file), file_name))
+    printf ("%s: no free run large enough\n", file_name);
+  file_close (file);
+}
@@ -6,6 +6,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include "filesys/cache.h"
 
 /* Identifies an inode. */
@@ -36,6 +37,19 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* Allocates one data sector, as close as possible after *HINT,
+   into *SECTORP and advances *HINT past it, so that the sectors
+   of a file are laid out contiguously where free space allows.
+   Returns true if successful, false if the disk is full. */
+static bool
+allocate_sector (block_sector_t *hint, block_sector_t *sectorp)
+{
+  if (!free_map_allocate_near (1, *hint, sectorp))
+    return false;
+  *hint = *sectorp + 1;
+  return true;
+}
+
 /* In-memory inode. */
 struct inode 
   {
@@ -43,7 +57,11 @@ struct inode
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool loading;                       /* True while data is read in. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    unsigned write_cnt;                 /* Number of writes since opened. */
+    struct lock lock;                   /* Serializes directory updates. */
+    struct lock map_lock;               /* Guards data and the counts. */
     struct inode_disk data;             /* Inode content. */
   };
 
@@ -80,11 +98,20 @@ byte_to_sector (const struct inode *inode, off_t pos)
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Protects open_inodes and the open_cnt and loading of every
+   inode on it. */
+static struct lock open_inodes_lock;
+
+/* Broadcast when an inode on open_inodes finishes loading. */
+static struct condition inode_loaded;
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
+  cond_init (&inode_loaded);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -96,6 +123,7 @@ bool
 inode_create (block_sector_t sector, off_t length, bool isdir)
 {
   struct inode_disk *disk_inode = NULL;
+  block_sector_t hint = sector;
   bool success = false;
 
   ASSERT (length >= 0);
@@ -120,7 +148,7 @@ inode_create (block_sector_t sector, off_t length, bool isdir)
 		int i = 0;
 		while (i < 10)
 		{
-			free_map_allocate (1, &disk_inode->blocks[i]);
+			allocate_sector (&hint, &disk_inode->blocks[i]);
 			block_write (fs_device, disk_inode->blocks[i], zeros);
 			i++;
 			sectors--;
@@ -134,11 +162,11 @@ inode_create (block_sector_t sector, off_t length, bool isdir)
 	if (!success)
 	{
 		struct indirect_block indirect_block;
-		free_map_allocate (1, &disk_inode->blocks[10]);
+		allocate_sector (&hint, &disk_inode->blocks[10]);
 		int j = 0;
 		while (j < 128)
 		{
-			free_map_allocate (1, &indirect_block.blocks[j]);
+			allocate_sector (&hint, &indirect_block.blocks[j]);
 			block_write (fs_device, indirect_block.blocks[j], zeros);
 			j++;
 			sectors--;
@@ -154,15 +182,15 @@ inode_create (block_sector_t sector, off_t length, bool isdir)
 	{
 		struct indirect_block first_block;
 		struct indirect_block second_block;
-		free_map_allocate (1, &disk_inode->blocks[11]);
+		allocate_sector (&hint, &disk_inode->blocks[11]);
 		int k = 0;
 		int l = 0;
 		while (k < 128)
 		{
-			free_map_allocate (1, &first_block.blocks[k]);
+			allocate_sector (&hint, &first_block.blocks[k]);
 			while (l < 128)
 			{
-				free_map_allocate (1, &second_block.blocks[l]);
+				allocate_sector (&hint, &second_block.blocks[l]);
 				block_write (fs_device, second_block.blocks[l], zeros);
 				l++;
 				sectors--;
@@ -197,13 +225,17 @@ inode_open (block_sector_t sector)
   struct inode *inode;
 
   /* Check whether this inode is already open. */
+  lock_acquire (&open_inodes_lock);
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
     {
       inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector) 
         {
-          inode_reopen (inode);
+          inode->open_cnt++;
+          while (inode->loading)
+            cond_wait (&inode_loaded, &open_inodes_lock);
+          lock_release (&open_inodes_lock);
           return inode; 
         }
     }
@@ -211,15 +243,32 @@ inode_open (block_sector_t sector)
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
+  /* Initialize.  The inode goes on the list marked as loading
+     and is read with open_inodes_lock released, so that opens of
+     other inodes need not wait for the disk; opens of this one
+     wait until it is loaded. */
   list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
+  inode->write_cnt = 0;
   inode->removed = false;
+  inode->loading = true;
+  lock_init (&inode->lock);
+  lock_init (&inode->map_lock);
+  lock_release (&open_inodes_lock);
+
   block_read (fs_device, inode->sector, &inode->data);
+
+  lock_acquire (&open_inodes_lock);
+  inode->loading = false;
+  cond_broadcast (&inode_loaded, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -228,7 +277,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -250,10 +303,12 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
+      lock_release (&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
@@ -320,6 +375,25 @@ inode_close (struct inode *inode)
 	}
       free (inode); 
     }
+  else
+    lock_release (&open_inodes_lock);
+}
+
+/* Acquires INODE's lock, which serializes lookups and updates of
+   the entries of a directory inode.  To avoid deadlock, a thread
+   that holds the lock of a directory may acquire the lock of one
+   of its children, but never the other way around. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+}
+
+/* Releases INODE's lock. */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -342,6 +416,12 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   struct cache *cache;
   while (size > 0) 
     {
+      /* The sector is looked up and pinned in the cache under
+         map_lock, so that inode_defrag() cannot move it in between,
+         but read in after, so that other threads can look up and
+         write the inode's sectors meanwhile. */
+      lock_acquire (&inode->map_lock);
+
       /* Disk sector to read, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
@@ -354,11 +434,16 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       /* Number of bytes to actually copy out of this sector. */
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
-        break;
-	cache = get_cache (sector_idx);
+        {
+          lock_release (&inode->map_lock);
+          break;
+        }
+	cache = pin_cache (sector_idx);
+	lock_release (&inode->map_lock);
+	fill_cache (cache);
 	memcpy (buffer + bytes_read, (uint8_t *) &cache->data + sector_ofs, chunk_size);
 	cache->accessed = true;
-	cache->used--;
+	release_cache (cache);
 
       /* Advance. */
       size -= chunk_size;
@@ -381,16 +466,24 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
   struct cache *cache;
-  if (inode->deny_write_cnt)
-    return 0;
 
+	lock_acquire (&inode->map_lock);
+	if (inode->deny_write_cnt)
+	{
+		lock_release (&inode->map_lock);
+		return 0;
+	}
+	inode->write_cnt++;
 	if (offset + size > inode->data.length)
 	{
 		inode_extend (inode, offset+size);
 	}
+	lock_release (&inode->map_lock);
 
   while (size > 0) 
     {
+      lock_acquire (&inode->map_lock);
+
       /* Sector to write, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
@@ -402,13 +495,22 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
-        break;
+        {
+          lock_release (&inode->map_lock);
+          break;
+        }
 
-	cache = get_cache (sector_idx);
+	/* A full sector is overwritten, so there is no need to read
+	   its old contents. */
+	if (chunk_size == BLOCK_SECTOR_SIZE)
+		cache = get_cache_overwrite (sector_idx);
+	else
+		cache = get_cache (sector_idx);
 	memcpy ((uint8_t *) &cache->data + sector_ofs, buffer + bytes_written, chunk_size);
 	cache->accessed = true;
 	cache->dirty = true;
-	cache->used--;
+	release_cache (cache);
+	lock_release (&inode->map_lock);
 
       /* Advance. */
       size -= chunk_size;
@@ -418,13 +520,118 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   return bytes_written;
 }
 
+/* Acquires the map_locks of A and B, which may be the same
+   inode, in order of sector number so that two copies in opposite
+   directions cannot deadlock. */
+static void
+lock_maps (struct inode *a, struct inode *b)
+{
+  if (a->sector > b->sector)
+    {
+      struct inode *t = a;
+      a = b;
+      b = t;
+    }
+  lock_acquire (&a->map_lock);
+  if (b != a)
+    lock_acquire (&b->map_lock);
+}
+
+/* Releases the locks taken by lock_maps(A, B). */
+static void
+unlock_maps (struct inode *a, struct inode *b)
+{
+  if (b != a)
+    lock_release (&b->map_lock);
+  lock_release (&a->map_lock);
+}
+
+/* Copies SIZE bytes from SRC, starting at SRC_OFS, into DST,
+   starting at DST_OFS, extending DST if necessary.  The data
+   moves from cache entry to cache entry without a bounce buffer,
+   and destination sectors that are overwritten completely are
+   never read.  If DST and SRC are the same inode, the ranges
+   are copied front to back, as if by memcpy().  Returns the
+   number of bytes copied, which may be less than SIZE if end of
+   SRC is reached or writes to DST are denied. */
+off_t
+inode_copy_at (struct inode *dst, off_t dst_ofs,
+               struct inode *src, off_t src_ofs, off_t size)
+{
+  off_t bytes_copied = 0;
+
+  lock_maps (dst, src);
+  if (dst->deny_write_cnt)
+    size = 0;
+  else if (size > inode_length (src) - src_ofs)
+    size = inode_length (src) - src_ofs;
+  if (size > 0)
+    dst->write_cnt++;
+  if (size > 0 && dst_ofs + size > inode_length (dst))
+    inode_extend (dst, dst_ofs + size);
+  unlock_maps (dst, src);
+
+  while (size > 0)
+    {
+      struct cache *out;
+      int sector_ofs, sector_left, chunk_size, done;
+
+      lock_maps (dst, src);
+
+      /* Destination sector and how much of it to fill. */
+      sector_ofs = dst_ofs % BLOCK_SECTOR_SIZE;
+      sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      chunk_size = size < sector_left ? size : sector_left;
+      if (dst_ofs + chunk_size > inode_length (dst)
+          || src_ofs + chunk_size > inode_length (src))
+        {
+          unlock_maps (dst, src);
+          break;
+        }
+      if (chunk_size == BLOCK_SECTOR_SIZE && dst != src)
+        out = get_cache_overwrite (byte_to_sector (dst, dst_ofs));
+      else
+        out = get_cache (byte_to_sector (dst, dst_ofs));
+
+      /* Fill it from the one or two source sectors that overlap. */
+      for (done = 0; done < chunk_size; )
+        {
+          off_t pos = src_ofs + done;
+          int in_ofs = pos % BLOCK_SECTOR_SIZE;
+          int n = BLOCK_SECTOR_SIZE - in_ofs;
+          struct cache *in = get_cache (byte_to_sector (src, pos));
+
+          if (n > chunk_size - done)
+            n = chunk_size - done;
+          memmove ((uint8_t *) &out->data + sector_ofs + done,
+                   (uint8_t *) &in->data + in_ofs, n);
+          in->accessed = true;
+          release_cache (in);
+          done += n;
+        }
+      out->accessed = true;
+      out->dirty = true;
+      release_cache (out);
+      unlock_maps (dst, src);
+
+      /* Advance. */
+      size -= chunk_size;
+      src_ofs += chunk_size;
+      dst_ofs += chunk_size;
+      bytes_copied += chunk_size;
+    }
+  return bytes_copied;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->map_lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->map_lock);
 }
 
 /* Re-enables writes to INODE.
@@ -433,9 +640,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->map_lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->map_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -450,6 +659,9 @@ inode_extend (struct inode *inode, off_t length)
 {
 	size_t sectors = bytes_to_sectors (inode->data.length);
 	size_t new_sectors = bytes_to_sectors (length) - sectors;
+	block_sector_t hint = (sectors > 0
+			       ? byte_to_sector (inode, inode->data.length - 1)
+			       : inode->sector);
 
 	if (new_sectors == 0)
 	{
@@ -461,7 +673,7 @@ inode_extend (struct inode *inode, off_t length)
 	int i = sectors;
 	while (i < 10)
 	{
-		if(!free_map_allocate (1, &inode->data.blocks[i]))
+		if(!allocate_sector (&hint, &inode->data.blocks[i]))
 		{
 			inode->data.length = length - new_sectors*BLOCK_SECTOR_SIZE;
 			return;
@@ -480,7 +692,7 @@ inode_extend (struct inode *inode, off_t length)
 	struct indirect_block indirect_block;
 	if(j == 0)
 	{
-		if(!free_map_allocate (1, &inode->data.blocks[10]))
+		if(!allocate_sector (&hint, &inode->data.blocks[10]))
 		{
 			inode->data.length = length - new_sectors*BLOCK_SECTOR_SIZE;
 			return;
@@ -490,7 +702,7 @@ inode_extend (struct inode *inode, off_t length)
 		block_read (fs_device, inode->data.blocks[10], &indirect_block);
 	while (j < 128)
 	{
-		if(!free_map_allocate (1, &indirect_block.blocks[j]))
+		if(!allocate_sector (&hint, &indirect_block.blocks[j]))
 		{
 			inode->data.length = length - new_sectors*BLOCK_SECTOR_SIZE;
 			block_write (fs_device, inode->data.blocks[10], &indirect_block);
@@ -514,7 +726,7 @@ inode_extend (struct inode *inode, off_t length)
 	struct indirect_block second_block;
 	if (k == 0 && l == 0)
 	{
-		if(!free_map_allocate (1, &inode->data.blocks[11]))
+		if(!allocate_sector (&hint, &inode->data.blocks[11]))
 		{
 			inode->data.length = length - new_sectors*BLOCK_SECTOR_SIZE;
 			return;
@@ -526,14 +738,14 @@ inode_extend (struct inode *inode, off_t length)
 	{
 		if (l == 0)
 		{
-			if(!free_map_allocate (1, &first_block.blocks[k]))
+			if(!allocate_sector (&hint, &first_block.blocks[k]))
 				break;
 		}
 		else
 			block_read (fs_device, first_block.blocks[k], &second_block);
 		while (l < 128)
 		{
-			if(!free_map_allocate (1, &second_block.blocks[l]))
+			if(!allocate_sector (&hint, &second_block.blocks[l]))
 				break;
 			block_write (fs_device, second_block.blocks[l], zeros);
 			l++;
@@ -568,6 +780,23 @@ int inode_get_cnt (const struct inode *inode)
 	return inode->open_cnt;
 }
 
+/* Returns how many writes INODE has had since it was opened, so
+   that a cache of its contents can tell when it is stale. */
+unsigned inode_write_cnt (struct inode *inode)
+{
+	unsigned cnt;
+
+	lock_acquire (&inode->map_lock);
+	cnt = inode->write_cnt;
+	lock_release (&inode->map_lock);
+	return cnt;
+}
+
+bool inode_is_removed (const struct inode *inode)
+{
+	return inode->removed;
+}
+
 block_sector_t inode_get_parent (const struct inode *inode)
 {
 	return inode->data.parent;
@@ -580,8 +809,160 @@ bool inode_set_parent (block_sector_t child, block_sector_t parent)
 		return false;
 	else
 	{
+		lock_acquire (&inode->map_lock);
 		inode->data.parent = parent;
+		lock_release (&inode->map_lock);
 		inode_close(inode);
 		return true;
 	}
 }
+
+/* Copies *POINTER into *SECTOR, or the other way if STORE. */
+static inline void
+map_sector (block_sector_t *pointer, block_sector_t *sector, bool store)
+{
+  if (store)
+    *pointer = *sector;
+  else
+    *sector = *pointer;
+}
+
+/* Copies the first CNT data sector pointers of INODE, in file
+   order, into SECTORS[], or, if STORE is true, overwrites them
+   with SECTORS[] and writes the changed index blocks back.  The
+   index blocks themselves stay where they are.  The caller must
+   hold INODE's map_lock. */
+static void
+map_sectors (struct inode *inode, block_sector_t *sectors, size_t cnt,
+             bool store)
+{
+  struct indirect_block first_block;
+  struct indirect_block second_block;
+  size_t i = 0;
+  int j, k;
+
+  for (j = 0; j < 10 && i < cnt; j++, i++)
+    map_sector (&inode->data.blocks[j], &sectors[i], store);
+  if (i < cnt)
+    {
+      block_read (fs_device, inode->data.blocks[10], &first_block);
+      for (j = 0; j < 128 && i < cnt; j++, i++)
+        map_sector (&first_block.blocks[j], &sectors[i], store);
+      if (store)
+        block_write (fs_device, inode->data.blocks[10], &first_block);
+    }
+  if (i < cnt)
+    {
+      block_read (fs_device, inode->data.blocks[11], &first_block);
+      for (k = 0; k < 128 && i < cnt; k++)
+        {
+          block_read (fs_device, first_block.blocks[k], &second_block);
+          for (j = 0; j < 128 && i < cnt; j++, i++)
+            map_sector (&second_block.blocks[j], &sectors[i], store);
+          if (store)
+            block_write (fs_device, first_block.blocks[k], &second_block);
+        }
+    }
+}
+
+/* Returns the number of runs of consecutive sectors that the CNT
+   sectors in SECTORS[] form. */
+static int
+count_fragments (const block_sector_t *sectors, size_t cnt)
+{
+  int fragments = cnt > 0;
+  size_t i;
+
+  for (i = 1; i < cnt; i++)
+    if (sectors[i] != sectors[i - 1] + 1)
+      fragments++;
+  return fragments;
+}
+
+/* Returns the number of runs of consecutive sectors that INODE's
+   data is split into, which is 0 for an empty inode and 1 for a
+   contiguous one, or -1 if memory is short. */
+int
+inode_fragments (struct inode *inode)
+{
+  block_sector_t *sectors;
+  size_t cnt;
+  int fragments = -1;
+
+  lock_acquire (&inode->map_lock);
+  cnt = bytes_to_sectors (inode->data.length);
+  sectors = cnt > 0 ? malloc (cnt * sizeof *sectors) : NULL;
+  if (cnt == 0)
+    fragments = 0;
+  else if (sectors != NULL)
+    {
+      map_sectors (inode, sectors, cnt, false);
+      fragments = count_fragments (sectors, cnt);
+      free (sectors);
+    }
+  lock_release (&inode->map_lock);
+  return fragments;
+}
+
+/* Moves the data of INODE, if it is fragmented, into a single run
+   of free sectors as close after the inode as possible, and
+   repoints its direct, indirect and doubly indirect pointers at
+   the new copy.  Readers and writers look sectors up under
+   map_lock, which is held throughout, so they see either the old
+   layout or the new one, never a mix.  Returns true if INODE's
+   data is contiguous afterward, false if no free run was large
+   enough or memory is short. */
+bool
+inode_defrag (struct inode *inode)
+{
+  block_sector_t *old, *new, start;
+  size_t cnt, i;
+  bool success = false;
+
+  lock_acquire (&inode->map_lock);
+  cnt = bytes_to_sectors (inode->data.length);
+  if (cnt == 0)
+    {
+      success = true;
+      goto done;
+    }
+  old = malloc (2 * cnt * sizeof *old);
+  if (old == NULL)
+    goto done;
+  new = old + cnt;
+
+  map_sectors (inode, old, cnt, false);
+  if (count_fragments (old, cnt) <= 1)
+    success = true;
+  else if (free_map_allocate_near (cnt, inode->sector, &start))
+    {
+      /* Copy through the cache, which may hold newer data than
+         the disk. */
+      for (i = 0; i < cnt; i++)
+        {
+          struct cache *src = get_cache (old[i]);
+          struct cache *dst = get_cache (start + i);
+          memcpy (dst->data, src->data, BLOCK_SECTOR_SIZE);
+          dst->accessed = true;
+          dst->dirty = true;
+          release_cache (dst);
+          release_cache (src);
+          new[i] = start + i;
+        }
+
+      /* Switch over, then give the old sectors back. */
+      map_sectors (inode, new, cnt, true);
+      block_write (fs_device, inode->sector, &inode->data);
+      for (i = 0; i < cnt; i++)
+        {
+          discard_cache (old[i]);
+          free_map_release (old[i], 1);
+        }
+      success = true;
+    }
+  free (old);
+
+ done:
+  lock_release (&inode->map_lock);
+  return success;
+}
@@ -14,15 +14,23 @@ struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+void inode_lock (struct inode *);
+void inode_unlock (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_copy_at (struct inode *dst, off_t dst_ofs,
+                     struct inode *src, off_t src_ofs, off_t size);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
 void inode_extend (struct inode *, off_t length);
+int inode_fragments (struct inode *);
+bool inode_defrag (struct inode *);
 
 bool inode_isdir(const struct inode *);
 int inode_get_cnt (const struct inode *inode);
+unsigned inode_write_cnt (struct inode *inode);
+bool inode_is_removed (const struct inode *inode);
 block_sector_t inode_get_parent(const struct inode *);
 bool inode_set_parent(block_sector_t child, block_sector_t parent);
 
@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -21,13 +22,24 @@ typedef unsigned long elem_type;
 /* Number of bits in an element. */
 #define ELEM_BITS (sizeof (elem_type) * CHAR_BIT)
 
+/* Bitmaps with at least this many elements keep summary words,
+   which let scans skip runs of uniform elements a word at a time
+   instead of an element at a time. */
+#define SUMMARY_MIN_ELEMS 8
+
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   Large bitmaps also have two summary arrays with one bit per
+   element of BITS: bit K of FULL is set if element K has all of
+   its bits set, and bit K of EMPTY is set if it has none set. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *full;    /* Summary of all-true elements, or null. */
+    elem_type *empty;   /* Summary of all-false elements, or null. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -68,6 +80,155 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns the number of bytes of summary words needed by a
+   bitmap of BIT_CNT bits. */
+static inline size_t
+summary_byte_cnt (size_t bit_cnt)
+{
+  size_t elems = elem_cnt (bit_cnt);
+  return elems >= SUMMARY_MIN_ELEMS ? 2 * byte_cnt (elems) : 0;
+}
+
+/* Points B's summary arrays into the storage just past its
+   elements, if B is large enough to have them. */
+static void
+summary_init (struct bitmap *b)
+{
+  size_t elems = elem_cnt (b->bit_cnt);
+  if (summary_byte_cnt (b->bit_cnt) > 0)
+    {
+      b->full = b->bits + elems;
+      b->empty = b->full + elem_cnt (elems);
+      memset (b->full, 0, summary_byte_cnt (b->bit_cnt));
+    }
+  else
+    b->full = b->empty = NULL;
+}
+
+/* Brings the summary bits for element IDX of B up to date.
+
+   This reads element IDX and then rewrites summary words that
+   are shared with other elements, so it is not atomic, and
+   neither are bitmap_mark(), bitmap_reset(), and bitmap_flip()
+   on a bitmap that has summary words: callers that change such
+   a bitmap from more than one thread must serialize the changes
+   with a lock of their own. */
+static inline void
+summary_update (struct bitmap *b, size_t idx)
+{
+  if (b->full != NULL)
+    {
+      elem_type used = (idx == elem_cnt (b->bit_cnt) - 1
+                        ? last_mask (b) : (elem_type) -1);
+      elem_type word = b->bits[idx] & used;
+      elem_type mask = bit_mask (idx);
+
+      if (word == used)
+        b->full[elem_idx (idx)] |= mask;
+      else
+        b->full[elem_idx (idx)] &= ~mask;
+      if (word == 0)
+        b->empty[elem_idx (idx)] |= mask;
+      else
+        b->empty[elem_idx (idx)] &= ~mask;
+    }
+}
+
+#ifdef FILESYS
+/* Recomputes all of B's summary bits. */
+static void
+summary_rebuild (struct bitmap *b)
+{
+  size_t i;
+
+  if (b->full != NULL)
+    for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+      summary_update (b, i);
+}
+#endif
+
+/* Returns the index of the lowest set bit in WORD, which must
+   not be zero.  See [IA32-v2a] "BSF". */
+static inline size_t
+first_set (elem_type word)
+{
+  elem_type idx;
+
+  ASSERT (word != 0);
+  asm ("bsfl %1, %0" : "=r" (idx) : "rm" (word) : "cc");
+  return idx;
+}
+
+/* Returns the number of set bits in WORD. */
+static inline size_t
+count_set (elem_type word)
+{
+  word = word - ((word >> 1) & 0x55555555);
+  word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+  word = (word + (word >> 4)) & 0x0f0f0f0f;
+  return (word * 0x01010101) >> 24;
+}
+
+/* Returns the index of the first element of B at or after
+   element IDX that contains at least one bit set to VALUE, or
+   the number of elements in B if there is none.  Uses the
+   summary words, when B has them, to skip elements that hold
+   only !VALUE bits a word of elements at a time. */
+static size_t
+next_elem (const struct bitmap *b, size_t idx, bool value)
+{
+  size_t cnt = elem_cnt (b->bit_cnt);
+  const elem_type *skip = value ? b->empty : b->full;
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t sidx;
+  elem_type word;
+
+  if (idx >= cnt)
+    return cnt;
+  if (skip == NULL)
+    {
+      while (idx < cnt && (b->bits[idx] ^ flip) == 0)
+        idx++;
+      return idx;
+    }
+
+  sidx = elem_idx (idx);
+  word = ~skip[sidx] & ~(bit_mask (idx) - 1);
+  while (word == 0)
+    {
+      if (++sidx >= elem_cnt (cnt))
+        return cnt;
+      word = ~skip[sidx];
+    }
+  idx = sidx * ELEM_BITS + first_set (word);
+  return idx < cnt ? idx : cnt;
+}
+
+/* Returns the index of the first bit at or after START in B that
+   is set to VALUE, or B's size if there is none. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx, bit;
+  elem_type word;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+
+  idx = elem_idx (start);
+  word = (b->bits[idx] ^ flip) & ~(bit_mask (start) - 1);
+  while (word == 0)
+    {
+      idx = next_elem (b, idx + 1, value);
+      if (idx >= elem_cnt (b->bit_cnt))
+        return b->bit_cnt;
+      word = b->bits[idx] ^ flip;
+    }
+  bit = idx * ELEM_BITS + first_set (word);
+  return bit < b->bit_cnt ? bit : b->bit_cnt;
+}
 
 /* Creation and destruction. */
 
@@ -82,9 +243,10 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
-      b->bits = malloc (byte_cnt (bit_cnt));
+      b->bits = malloc (byte_cnt (bit_cnt) + summary_byte_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
+          summary_init (b);
           bitmap_set_all (b, false);
           return b;
         }
@@ -105,6 +267,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  summary_init (b);
   bitmap_set_all (b, false);
   return b;
 }
@@ -114,7 +277,8 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt) 
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return sizeof (struct bitmap) + byte_cnt (bit_cnt)
+         + summary_byte_cnt (bit_cnt);
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -153,7 +317,8 @@ bitmap_set (struct bitmap *b, size_t idx, bool value)
     bitmap_reset (b, idx);
 }
 
-/* Atomically sets the bit numbered BIT_IDX in B to true. */
+/* Atomically sets the bit numbered BIT_IDX in B to true, but see
+   summary_update() for large bitmaps. */
 void
 bitmap_mark (struct bitmap *b, size_t bit_idx) 
 {
@@ -164,9 +329,11 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  summary_update (b, idx);
 }
 
-/* Atomically sets the bit numbered BIT_IDX in B to false. */
+/* Atomically sets the bit numbered BIT_IDX in B to false, but see
+   summary_update() for large bitmaps. */
 void
 bitmap_reset (struct bitmap *b, size_t bit_idx) 
 {
@@ -177,11 +344,13 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  summary_update (b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
    that is, if it is true, makes it false,
-   and if it is false, makes it true. */
+   and if it is false, makes it true.  But see summary_update()
+   for large bitmaps. */
 void
 bitmap_flip (struct bitmap *b, size_t bit_idx) 
 {
@@ -192,6 +361,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  summary_update (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -214,18 +384,46 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Returns a mask of the bits of element elem_idx(START) that lie
+   between bit START and bit END, exclusive, and stores the index
+   of the first bit past them into *NEXT. */
+static inline elem_type
+range_mask (size_t start, size_t end, size_t *next)
+{
+  size_t ofs = start % ELEM_BITS;
+  size_t cnt = ELEM_BITS - ofs;
+
+  if (cnt > end - start)
+    cnt = end - start;
+  *next = start + cnt;
+  return (cnt == ELEM_BITS
+          ? (elem_type) -1
+          : (((elem_type) 1 << cnt) - 1) << ofs);
+}
+
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, a whole element at a
+   time, but the range as a whole is not. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t i, end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  for (i = start; i < end; )
+    {
+      size_t idx = elem_idx (i);
+      elem_type mask = range_mask (i, end, &i);
+
+      if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+      summary_update (b, idx);
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -233,17 +431,18 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t i, end = start + cnt, true_cnt = 0;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  for (i = start; i < end; )
+    {
+      size_t idx = elem_idx (i);
+      true_cnt += count_set (b->bits[idx] & range_mask (i, end, &i));
+    }
+  return value ? true_cnt : cnt - true_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -251,16 +450,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return cnt > 0 && next_bit (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -292,22 +486,39 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   The scan jumps from run to run: it finds the first VALUE bit
+   with find-first-set on whole elements, skipping elements (and,
+   in large bitmaps, words of elements) that hold none, then finds
+   where that run ends the same way.  Its cost is proportional to
+   the number of runs and elements passed over, not to the number
+   of bits times CNT. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t i;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt > b->bit_cnt)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+
+  for (i = start; ; )
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t first = next_bit (b, i, value);
+      size_t end;
+
+      if (first >= b->bit_cnt || cnt > b->bit_cnt - first)
+        return BITMAP_ERROR;
+      end = next_bit (b, first, !value);
+      if (end - first >= cnt)
+        return first;
+      i = end;
     }
-  return BITMAP_ERROR;
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -325,6 +536,16 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
     bitmap_set_multiple (b, idx, cnt, !value);
   return idx;
 }
+
+/* Returns the index of the first bit at or after START in B that
+   is set to VALUE, or B's size if there is none.  Like
+   bitmap_scan(), looks at a word of bits at a time. */
+size_t
+bitmap_next (const struct bitmap *b, size_t start, bool value)
+{
+  ASSERT (b != NULL);
+  return next_bit (b, start, value);
+}
 
 /* File input and output. */
 
@@ -347,6 +568,7 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      summary_rebuild (b);
     }
   return success;
 }
@@ -359,6 +581,22 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes at byte offset OFS of B's file image to
+   the same offset in FILE, clipped to the end of the image.
+   Returns true if successful, false otherwise. */
+bool
+bitmap_write_part (const struct bitmap *b, struct file *file,
+                   size_t ofs, size_t size)
+{
+  size_t file_size = byte_cnt (b->bit_cnt);
+  if (ofs >= file_size)
+    return true;
+  if (size > file_size - ofs)
+    size = file_size - ofs;
+  return file_write_at (file, (uint8_t *) b->bits + ofs, size, ofs)
+         == (off_t) size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -148,13 +148,16 @@ puts (const char *s)
   return 0;
 }
 
-/* Writes the N characters in BUFFER to the console. */
+/* Writes the N characters in BUFFER to the console.
+   Hands the whole buffer to each device at once, instead of a
+   character at a time, so that they can batch their work. */
 void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  write_cnt += n;
+  serial_write (buffer, n);
+  vga_write (buffer, n);
   release_console ();
 }
 
@@ -0,0 +1,17 @@
+#ifndef __LIB_RDTSC_H
+#define __LIB_RDTSC_H
+
+#include <stdint.h>
+
+/* Returns the processor's time stamp counter, which counts
+   cycles since reset.  Used to time system calls in the kernel
+   and by the benchmarks under tests/. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* lib/rdtsc.h */
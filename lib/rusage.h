@@ -0,0 +1,24 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+#include <stdint.h>
+
+/* Resource usage of a process, as reported by getrusage(). */
+struct rusage
+  {
+    int64_t utime;              /* Timer ticks spent in user mode. */
+    int64_t stime;              /* Timer ticks spent in the kernel. */
+    unsigned minflt;            /* Page faults served without I/O. */
+    unsigned majflt;            /* Page faults that read a page in. */
+    unsigned swapins;           /* Pages read back from swap. */
+    unsigned swapouts;          /* Pages written out to swap. */
+    int64_t read_bytes;         /* Bytes read by system calls. */
+    int64_t write_bytes;        /* Bytes written by system calls. */
+    unsigned maxrss;            /* Most frames resident at once. */
+  };
+
+/* Whose usage getrusage() reports. */
+#define RUSAGE_SELF 0           /* The calling process. */
+#define RUSAGE_CHILDREN 1       /* Its children that it waited for. */
+
+#endif /* lib/rusage.h */
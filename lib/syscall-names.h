@@ -0,0 +1,29 @@
+#ifndef __LIB_SYSCALL_NAMES_H
+#define __LIB_SYSCALL_NAMES_H
+
+#include <syscall-nr.h>
+
+/* System call names, indexed by number, for printing
+   statistics. */
+static const char *const syscall_names[SYS_CNT] =
+  {
+    [SYS_HALT] = "halt", [SYS_EXIT] = "exit", [SYS_EXEC] = "exec",
+    [SYS_WAIT] = "wait", [SYS_CREATE] = "create", [SYS_REMOVE] = "remove",
+    [SYS_OPEN] = "open", [SYS_FILESIZE] = "filesize", [SYS_READ] = "read",
+    [SYS_WRITE] = "write", [SYS_SEEK] = "seek", [SYS_TELL] = "tell",
+    [SYS_CLOSE] = "close", [SYS_MMAP] = "mmap", [SYS_MUNMAP] = "munmap",
+    [SYS_CHDIR] = "chdir", [SYS_MKDIR] = "mkdir",
+    [SYS_READDIR] = "readdir", [SYS_ISDIR] = "isdir",
+    [SYS_INUMBER] = "inumber", [SYS_PREAD] = "pread",
+    [SYS_PWRITE] = "pwrite", [SYS_READV] = "readv",
+    [SYS_WRITEV] = "writev", [SYS_SYSSTATS] = "sysstats",
+    [SYS_COPY_FILE_RANGE] = "copy_file_range",
+    [SYS_AIO_SETUP] = "aio_setup", [SYS_AIO_ENTER] = "aio_enter",
+    [SYS_FORK] = "fork", [SYS_GETRUSAGE] = "getrusage",
+    [SYS_WAIT_ANY] = "wait_any", [SYS_SBRK] = "sbrk",
+    [SYS_MMAP_ANON] = "mmap_anon", [SYS_THREAD_SPAWN] = "thread_spawn",
+    [SYS_THREAD_JOIN] = "thread_join", [SYS_THREAD_END] = "thread_end",
+    [SYS_FUTEX_WAIT] = "futex_wait", [SYS_FUTEX_WAKE] = "futex_wake",
+  };
+
+#endif /* lib/syscall-names.h */
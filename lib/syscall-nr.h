@@ -28,7 +28,29 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_PREAD,                  /* Read from a file at an offset. */
+    SYS_PWRITE,                 /* Write to a file at an offset. */
+    SYS_READV,                  /* Read into several buffers. */
+    SYS_WRITEV,                 /* Write from several buffers. */
+    SYS_SYSSTATS,               /* Report system call statistics. */
+    SYS_COPY_FILE_RANGE,        /* Copy between files in the kernel. */
+    SYS_AIO_SETUP,              /* Register asynchronous I/O rings. */
+    SYS_AIO_ENTER,              /* Submit and wait for asynchronous I/O. */
+    SYS_FORK,                   /* Clone this process. */
+    SYS_GETRUSAGE,              /* Report resource usage. */
+    SYS_WAIT_ANY,               /* Wait for whichever child exits first. */
+    SYS_SBRK,                   /* Grow or shrink the heap. */
+    SYS_MMAP_ANON,              /* Map zero-filled memory. */
+    SYS_THREAD_SPAWN,           /* Start a thread in this process. */
+    SYS_THREAD_JOIN,            /* Wait for a thread to end. */
+    SYS_THREAD_END,             /* End the calling thread. */
+    SYS_FUTEX_WAIT,             /* Sleep while a word holds a value. */
+    SYS_FUTEX_WAKE,             /* Wake threads sleeping on a word. */
+
+    SYS_CNT                     /* Number of system calls. */
   };
 
 #endif /* lib/syscall-nr.h */
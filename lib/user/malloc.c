@@ -0,0 +1,439 @@
+#include <malloc.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* User-space malloc().
+
+   Works like the kernel's malloc() in threads/malloc.c.  Each
+   request of up to 1 kB is rounded up to a power of 2 and served
+   from the free list of the descriptor for that size.  The blocks
+   come from page-sized "arenas" that begin with a header naming
+   their descriptor, so free() finds the descriptor by rounding
+   the block's address down to a page.  Bigger requests get
+   contiguous pages of their own, with the page count in the
+   arena header.
+
+   Pages come from sbrk() instead of a page allocator.  Freed
+   pages go on a list of free runs, kept in address order so that
+   neighbours merge.  A run that ends at the break goes back to
+   the kernel, so a program that frees everything leaves its heap
+   as small as it found it.
+
+   The threads of a process share the heap, so malloc() and
+   free() hold a lock built on a futex. */
+
+/* Size of a page, the unit in which the heap grows. */
+#define PAGE_SIZE 4096
+
+/* Free block. */
+struct block
+  {
+    struct block *prev;         /* Previous block in free list. */
+    struct block *next;         /* Next block in free list. */
+  };
+
+/* Descriptor. */
+struct desc
+  {
+    size_t block_size;          /* Size of each element in bytes. */
+    size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    struct block *free_list;    /* List of free blocks. */
+  };
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* Arena. */
+struct arena
+  {
+    unsigned magic;             /* Always set to ARENA_MAGIC. */
+    struct desc *desc;          /* Owning descriptor, null for big block. */
+    size_t free_cnt;            /* Free blocks; pages in big block. */
+  };
+
+/* A run of free pages. */
+struct run
+  {
+    struct run *next;           /* Next run, at a higher address. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+/* Our set of descriptors, one per power of 2 from 16 bytes to
+   1 kB, as in the kernel. */
+#define DESC(SIZE) {SIZE, (PAGE_SIZE - sizeof (struct arena)) / (SIZE), NULL}
+static struct desc descs[] =
+  {
+    DESC (16), DESC (32), DESC (64), DESC (128), DESC (256), DESC (512),
+    DESC (1024),
+  };
+#define DESC_CNT (sizeof descs / sizeof *descs)
+
+/* Free runs of pages, in address order. */
+static struct run *free_runs;
+
+/* Lock on the heap: 0 if free, 1 if held, 2 if held and threads
+   may be asleep on it. */
+static int heap_lock;
+
+static struct arena *block_to_arena (struct block *);
+static struct block *arena_to_block (struct arena *, size_t idx);
+static void *get_pages (size_t page_cnt);
+static void free_pages (void *, size_t page_cnt);
+static void *malloc_locked (size_t);
+static void free_locked (void *);
+
+/* Acquires heap_lock.  An uncontended acquire is one atomic
+   instruction; otherwise the thread marks the lock contended
+   and sleeps on it until it gets it. */
+static void
+heap_acquire (void)
+{
+  int c = __sync_val_compare_and_swap (&heap_lock, 0, 1);
+  if (c != 0)
+    {
+      if (c != 2)
+        c = __sync_lock_test_and_set (&heap_lock, 2);
+      while (c != 0)
+        {
+          futex_wait (&heap_lock, 2);
+          c = __sync_lock_test_and_set (&heap_lock, 2);
+        }
+    }
+}
+
+/* Releases heap_lock, waking a sleeper if there may be one. */
+static void
+heap_release (void)
+{
+  if (__sync_fetch_and_sub (&heap_lock, 1) != 1)
+    {
+      heap_lock = 0;
+      futex_wake (&heap_lock, 1);
+    }
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  void *p;
+
+  heap_acquire ();
+  p = malloc_locked (size);
+  heap_release ();
+  return p;
+}
+
+/* Does the work of malloc() for a caller holding heap_lock. */
+static void *
+malloc_locked (size_t size)
+{
+  struct desc *d;
+  struct block *b;
+  struct arena *a;
+
+  /* A null pointer satisfies a request for 0 bytes. */
+  if (size == 0)
+    return NULL;
+
+  /* Find the smallest descriptor that satisfies a SIZE-byte
+     request. */
+  for (d = descs; d < descs + DESC_CNT; d++)
+    if (d->block_size >= size)
+      break;
+  if (d == descs + DESC_CNT)
+    {
+      /* SIZE is too big for any descriptor.
+         Allocate enough pages to hold SIZE plus an arena. */
+      size_t page_cnt;
+
+      if (size > SIZE_MAX - sizeof *a - PAGE_SIZE)
+        return NULL;
+      page_cnt = DIV_ROUND_UP (size + sizeof *a, PAGE_SIZE);
+      a = get_pages (page_cnt);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize the arena to indicate a big block of PAGE_CNT
+         pages, and return it. */
+      a->magic = ARENA_MAGIC;
+      a->desc = NULL;
+      a->free_cnt = page_cnt;
+      return a + 1;
+    }
+
+  /* If the free list is empty, create a new arena. */
+  if (d->free_list == NULL)
+    {
+      size_t i;
+
+      a = get_pages (1);
+      if (a == NULL)
+        return NULL;
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = d->blocks_per_arena; i-- > 0; )
+        {
+          b = arena_to_block (a, i);
+          b->prev = NULL;
+          b->next = d->free_list;
+          if (b->next != NULL)
+            b->next->prev = b;
+          d->free_list = b;
+        }
+    }
+
+  /* Get a block from free list and return it. */
+  b = d->free_list;
+  d->free_list = b->next;
+  if (b->next != NULL)
+    b->next->prev = NULL;
+  a = block_to_arena (b);
+  a->free_cnt--;
+  return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  size = a * b;
+  if (b != 0 && size / b != a)
+    return NULL;
+
+  /* Allocate and zero memory. */
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+
+  return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block)
+{
+  struct block *b = block;
+  struct arena *a = block_to_arena (b);
+  struct desc *d = a->desc;
+
+  return d != NULL ? d->block_size : PAGE_SIZE * a->free_cnt - sizeof *a;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK).
+   A block that is already big enough is returned as is. */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  else if (old_block != NULL && new_size <= block_size (old_block))
+    return old_block;
+  else
+    {
+      void *new_block = malloc (new_size);
+      if (old_block != NULL && new_block != NULL)
+        {
+          memcpy (new_block, old_block, block_size (old_block));
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  if (p != NULL)
+    {
+      heap_acquire ();
+      free_locked (p);
+      heap_release ();
+    }
+}
+
+/* Does the work of free() for a caller holding heap_lock. */
+static void
+free_locked (void *p)
+{
+  if (p != NULL)
+    {
+      struct block *b = p;
+      struct arena *a = block_to_arena (b);
+      struct desc *d = a->desc;
+
+      if (d != NULL)
+        {
+          /* It's a normal block.  Add it to the free list. */
+          b->prev = NULL;
+          b->next = d->free_list;
+          if (b->next != NULL)
+            b->next->prev = b;
+          d->free_list = b;
+
+          /* If the arena is now entirely unused, free it. */
+          if (++a->free_cnt >= d->blocks_per_arena)
+            {
+              size_t i;
+
+              ASSERT (a->free_cnt == d->blocks_per_arena);
+              for (i = 0; i < d->blocks_per_arena; i++)
+                {
+                  b = arena_to_block (a, i);
+                  if (b->prev != NULL)
+                    b->prev->next = b->next;
+                  else
+                    d->free_list = b->next;
+                  if (b->next != NULL)
+                    b->next->prev = b->prev;
+                }
+              free_pages (a, 1);
+            }
+        }
+      else
+        {
+          /* It's a big block.  Free its pages. */
+          free_pages (a, a->free_cnt);
+        }
+    }
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (struct block *b)
+{
+  struct arena *a = (struct arena *) ((uintptr_t) b & ~(PAGE_SIZE - 1));
+
+  /* Check that the arena is valid. */
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+
+  /* Check that the block is properly aligned for the arena. */
+  ASSERT (a->desc == NULL
+          || ((uintptr_t) b - (uintptr_t) (a + 1)) % a->desc->block_size == 0);
+  ASSERT (a->desc != NULL || (struct arena *) b == a + 1);
+
+  return a;
+}
+
+/* Returns the (IDX - 1)'th block within arena A. */
+static struct block *
+arena_to_block (struct arena *a, size_t idx)
+{
+  ASSERT (a != NULL);
+  ASSERT (a->magic == ARENA_MAGIC);
+  ASSERT (idx < a->desc->blocks_per_arena);
+  return (struct block *) ((uint8_t *) a
+                           + sizeof *a
+                           + idx * a->desc->block_size);
+}
+
+/* Returns the address just past the pages of run R. */
+static uint8_t *
+run_end (struct run *r)
+{
+  return (uint8_t *) r + r->page_cnt * PAGE_SIZE;
+}
+
+/* Returns PAGE_CNT contiguous, page-aligned pages, taken from the
+   first free run big enough or else from the kernel by raising
+   the break.  Returns a null pointer if memory is not
+   available. */
+static void *
+get_pages (size_t page_cnt)
+{
+  struct run **rp, *r;
+  uint8_t *brk;
+  size_t pad;
+
+  for (rp = &free_runs; (r = *rp) != NULL; rp = &r->next)
+    if (r->page_cnt >= page_cnt)
+      {
+        if (r->page_cnt == page_cnt)
+          *rp = r->next;
+        else
+          {
+            struct run *rest = (struct run *) ((uint8_t *) r
+                                               + page_cnt * PAGE_SIZE);
+            rest->next = r->next;
+            rest->page_cnt = r->page_cnt - page_cnt;
+            *rp = rest;
+          }
+        return r;
+      }
+
+  /* Someone else may have left the break in mid-page. */
+  brk = sbrk (0);
+  pad = ROUND_UP ((uintptr_t) brk, PAGE_SIZE) - (uintptr_t) brk;
+  if (page_cnt > (INTPTR_MAX - pad) / PAGE_SIZE)
+    return NULL;
+  brk = sbrk (pad + page_cnt * PAGE_SIZE);
+  if (brk == (void *) -1)
+    return NULL;
+  return brk + pad;
+}
+
+/* Puts the PAGE_CNT pages at PAGES on the free list, merging them
+   with the runs on either side, and lowers the break if the
+   highest run ends at it. */
+static void
+free_pages (void *pages, size_t page_cnt)
+{
+  struct run *r = pages;
+  struct run **rp = &free_runs;
+
+  /* Find where R goes and merge it with the run after it. */
+  while (*rp != NULL && *rp < r)
+    rp = &(*rp)->next;
+  r->page_cnt = page_cnt;
+  r->next = *rp;
+  if (r->next != NULL && run_end (r) == (uint8_t *) r->next)
+    {
+      r->page_cnt += r->next->page_cnt;
+      r->next = r->next->next;
+    }
+  *rp = r;
+
+  /* Merge with the run before, then give back the last run if it
+     is at the top of the heap. */
+  for (rp = &free_runs; *rp != NULL; rp = &(*rp)->next)
+    {
+      struct run *cur = *rp;
+      if (cur->next == r && run_end (cur) == (uint8_t *) r)
+        {
+          cur->page_cnt += r->page_cnt;
+          cur->next = r->next;
+        }
+      if (cur->next == NULL)
+        {
+          if (run_end (cur) == sbrk (0))
+            {
+              *rp = NULL;
+              sbrk (-(intptr_t) (cur->page_cnt * PAGE_SIZE));
+            }
+          break;
+        }
+    }
+}
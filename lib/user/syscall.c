@@ -64,6 +64,25 @@
           retval;                                               \
         })
 
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; "                                  \
+             "pushl %[number]; int $0x30; addl $20, %%esp"      \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "r" (ARG3)                              \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
 void
 halt (void) 
 {
@@ -186,3 +205,119 @@ inumber (int fd)
   return syscall1 (SYS_INUMBER, fd);
 }
 
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+sysstats (bool global, struct sysstat *stats, int cnt)
+{
+  return syscall3 (SYS_SYSSTATS, global, stats, cnt);
+}
+
+int
+copy_file_range (int in_fd, int out_fd, unsigned length)
+{
+  return syscall3 (SYS_COPY_FILE_RANGE, in_fd, out_fd, length);
+}
+
+int
+aio_setup (struct aio_ring *ring)
+{
+  return syscall1 (SYS_AIO_SETUP, ring);
+}
+
+int
+aio_enter (unsigned min_complete)
+{
+  return syscall1 (SYS_AIO_ENTER, min_complete);
+}
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+int
+getrusage (int who, struct rusage *usage)
+{
+  return syscall2 (SYS_GETRUSAGE, who, usage);
+}
+
+pid_t
+wait_any (int *status)
+{
+  return (pid_t) syscall1 (SYS_WAIT_ANY, status);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+mapid_t
+mmap_anon (void *addr, size_t length)
+{
+  return syscall2 (SYS_MMAP_ANON, addr, length);
+}
+
+/* Runs in a new thread: calls FUNC with AUX and ends the thread
+   with its return value. */
+static void
+thread_start (int (*func) (void *), void *aux)
+{
+  thread_end (func (aux));
+}
+
+thrid_t
+thread_spawn (int (*func) (void *), void *aux)
+{
+  return (thrid_t) syscall3 (SYS_THREAD_SPAWN, thread_start, func, aux);
+}
+
+int
+thread_join (thrid_t tid)
+{
+  return syscall1 (SYS_THREAD_JOIN, tid);
+}
+
+void
+thread_end (int status)
+{
+  syscall1 (SYS_THREAD_END, status);
+  NOT_REACHED ();
+}
+
+int
+futex_wait (int *addr, int val)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, val);
+}
+
+int
+futex_wake (int *addr, int cnt)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, cnt);
+}
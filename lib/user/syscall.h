@@ -2,7 +2,9 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
+#include <rusage.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -12,9 +14,83 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Identifier of a thread within a process. */
+typedef int thrid_t;
+#define THRID_ERROR ((thrid_t) -1)
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* One buffer of a readv() or writev() call. */
+struct iovec
+  {
+    void *iov_base;             /* Start of buffer. */
+    size_t iov_len;             /* Length of buffer in bytes. */
+  };
+
+/* Maximum number of buffers in one readv() or writev() call. */
+#define IOV_MAX 32
+
+/* Number of buckets in a system call latency histogram.
+   Bucket I counts calls that took from 2**(SYSSTAT_SHIFT + I)
+   cycles up to twice that; the first bucket also counts faster
+   calls and the last one slower calls. */
+#define SYSSTAT_BUCKETS 16
+#define SYSSTAT_SHIFT 8
+
+/* Statistics for one system call number, as reported by
+   sysstats().  Calls that do not return, such as exit(), are not
+   counted. */
+struct sysstat
+  {
+    unsigned count;                     /* Number of calls. */
+    unsigned long long cycles;          /* Total time stamp counter cycles. */
+    unsigned hist[SYSSTAT_BUCKETS];     /* Latency histogram. */
+  };
+
+/* Asynchronous I/O.  The process owns a struct aio_ring, which
+   it registers with aio_setup().  It queues requests by filling
+   in submission queue entries and advancing sq_tail, then calls
+   aio_enter(), which hands them to kernel worker threads and
+   waits for completions.  The kernel posts one completion queue
+   entry per request, advancing cq_tail, and the process consumes
+   them by advancing cq_head.  Indexes run freely and are reduced
+   modulo AIO_RING_SIZE. */
+#define AIO_RING_SIZE 32        /* Entries per queue, a power of 2. */
+#define AIO_MAX_LEN 65536       /* Maximum bytes per request. */
+
+#define AIO_READ 0              /* Read, like pread(). */
+#define AIO_WRITE 1             /* Write, like pwrite(). */
+
+/* Submission queue entry. */
+struct aio_sqe
+  {
+    int opcode;                 /* AIO_READ or AIO_WRITE. */
+    int fd;                     /* File descriptor. */
+    void *buf;                  /* Buffer to read into or write from. */
+    unsigned len;               /* Bytes to transfer. */
+    unsigned offset;            /* File offset. */
+    unsigned user_data;         /* Copied to the completion. */
+  };
+
+/* Completion queue entry. */
+struct aio_cqe
+  {
+    unsigned user_data;         /* From the submission. */
+    int res;                    /* Bytes transferred, or -1. */
+  };
+
+/* Submission and completion queues. */
+struct aio_ring
+  {
+    unsigned sq_head;           /* Next entry to submit; kernel's. */
+    unsigned sq_tail;           /* End of queued entries; process's. */
+    unsigned cq_head;           /* Next entry to consume; process's. */
+    unsigned cq_tail;           /* End of posted entries; kernel's. */
+    struct aio_sqe sq[AIO_RING_SIZE];
+    struct aio_cqe cq[AIO_RING_SIZE];
+  };
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -45,4 +121,24 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int sysstats (bool global, struct sysstat *stats, int cnt);
+int copy_file_range (int in_fd, int out_fd, unsigned length);
+int aio_setup (struct aio_ring *);
+int aio_enter (unsigned min_complete);
+pid_t fork (void);
+int getrusage (int who, struct rusage *usage);
+pid_t wait_any (int *status);
+void *sbrk (intptr_t increment);
+mapid_t mmap_anon (void *addr, size_t length);
+thrid_t thread_spawn (int (*func) (void *), void *aux);
+int thread_join (thrid_t);
+void thread_end (int status) NO_RETURN;
+int futex_wait (int *addr, int val);
+int futex_wake (int *addr, int cnt);
+
 #endif /* lib/user/syscall.h */
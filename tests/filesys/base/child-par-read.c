@@ -0,0 +1,32 @@
+/* Child process for the par-read benchmark.
+   Reads the whole test file in CHUNK_SIZE pieces and checks that
+   it has the expected length. */
+
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/par-read.h"
+
+const char *test_name = "child-par-read";
+
+static char buf[CHUNK_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  size_t total = 0;
+  int bytes;
+  int fd;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  while ((bytes = read (fd, buf, sizeof buf)) > 0)
+    total += bytes;
+  CHECK (total == FILE_SIZE, "read %zu bytes of \"%s\", expected %d",
+         total, file_name, FILE_SIZE);
+  close (fd);
+
+  return atoi (argv[1]);
+}
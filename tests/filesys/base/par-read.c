@@ -0,0 +1,49 @@
+/* Benchmark for concurrent reads through the file system.
+
+   Writes a file larger than the buffer cache, then times 1, 2, 4,
+   and 8 child processes each reading the whole file at once, and
+   reports the total cycles and the aggregate throughput, as
+   measured by the time stamp counter.  With a single global file
+   system lock every read waits for the others' disk accesses;
+   with per-inode locking and a cache that reads sectors without
+   holding its lock, the readers' requests overlap and throughput
+   should rise with the number of readers. */
+
+#include <inttypes.h>
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/par-read.h"
+
+#define MAX_CHILDREN 8
+
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  pid_t children[MAX_CHILDREN];
+  size_t child_cnt;
+  int fd;
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  for (child_cnt = 1; child_cnt <= MAX_CHILDREN; child_cnt *= 2)
+    {
+      uint64_t start = rdtsc ();
+      uint64_t cycles;
+
+      exec_children ("child-par-read", children, child_cnt);
+      wait_children (children, child_cnt);
+      cycles = rdtsc () - start;
+      msg ("%zu readers: %"PRIu64" cycles, %"PRIu64" kB per Mcycle",
+           child_cnt, cycles,
+           (uint64_t) child_cnt * FILE_SIZE / 1024 * 1000000 / cycles);
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef TESTS_FILESYS_BASE_PAR_READ_H
+#define TESTS_FILESYS_BASE_PAR_READ_H
+
+/* Twice the size of the buffer cache, so that the readers keep
+   missing and going to disk. */
+#define FILE_SIZE (128 * 1024)
+#define CHUNK_SIZE 4096
+static const char file_name[] = "par-data";
+
+#endif /* tests/filesys/base/par-read.h */
@@ -0,0 +1,172 @@
+/* Test and microbenchmark program for lib/kernel/bitmap.c.
+
+   Checks bitmap_scan() against a straightforward bit-by-bit
+   reference scan, then times both on nearly full bitmaps the size
+   of the free map of an 8 MB disk and of the used map of a 4 MB
+   page pool, the cases where the reference scan is slowest.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/test.h"
+#include "threads/vaddr.h"
+
+/* Number of bits in the bitmaps we benchmark. */
+#define DISK_BITS ((8 * 1024 * 1024) / BLOCK_SECTOR_SIZE)
+#define POOL_BITS ((4 * 1024 * 1024) / PGSIZE)
+
+/* Number of scans timed per benchmark. */
+#define SCAN_CNT 2000
+
+static size_t reference_scan (const struct bitmap *, size_t start,
+                              size_t cnt, bool value);
+static void verify_scans (size_t bit_cnt);
+static void fill_nearly_full (struct bitmap *, size_t free_cnt);
+static void benchmark (const char *name, size_t bit_cnt, size_t free_cnt,
+                       size_t cnt);
+
+/* Test the bitmap implementation. */
+void
+test (void)
+{
+  size_t bit_cnt;
+
+  printf ("testing various size bitmaps:");
+  for (bit_cnt = 0; bit_cnt <= 1024; bit_cnt = bit_cnt * 2 + 1)
+    {
+      printf (" %zu", bit_cnt);
+      verify_scans (bit_cnt);
+    }
+  printf (" done\n");
+
+  benchmark ("8 MB disk", DISK_BITS, 16, 1);
+  benchmark ("8 MB disk", DISK_BITS, 64, 2);
+  benchmark ("4 MB pool", POOL_BITS, 4, 1);
+  benchmark ("4 MB pool", POOL_BITS, 16, 2);
+}
+
+/* Returns what bitmap_scan() returned before it learned to skip
+   whole elements: tests every starting bit in turn. */
+static size_t
+reference_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  if (cnt <= bitmap_size (b))
+    {
+      size_t last = bitmap_size (b) - cnt;
+      size_t i, j;
+
+      for (i = start; i <= last; i++)
+        {
+          for (j = 0; j < cnt; j++)
+            if (bitmap_test (b, i + j) != value)
+              break;
+          if (j == cnt)
+            return i;
+        }
+    }
+  return BITMAP_ERROR;
+}
+
+/* Fills bitmaps of BIT_CNT bits at several densities and checks
+   bitmap_scan(), bitmap_count(), and bitmap_contains() against the
+   bit-by-bit answers. */
+static void
+verify_scans (size_t bit_cnt)
+{
+  struct bitmap *b = bitmap_create (bit_cnt);
+  int density;
+
+  ASSERT (b != NULL);
+  for (density = 0; density <= 100; density += 25)
+    {
+      size_t i, start, cnt, ref_cnt;
+
+      for (i = 0; i < bit_cnt; i++)
+        bitmap_set (b, i, (int) (random_ulong () % 100) < density);
+
+      for (start = 0; start <= bit_cnt; start += 1 + bit_cnt / 16)
+        for (cnt = 0; cnt <= 8; cnt++)
+          {
+            ASSERT (bitmap_scan (b, start, cnt, false)
+                    == reference_scan (b, start, cnt, false));
+            ASSERT (bitmap_scan (b, start, cnt, true)
+                    == reference_scan (b, start, cnt, true));
+          }
+
+      for (start = 0; start < bit_cnt; start += 1 + bit_cnt / 16)
+        {
+          cnt = bit_cnt - start;
+          ref_cnt = 0;
+          for (i = start; i < bit_cnt; i++)
+            ref_cnt += bitmap_test (b, i);
+          ASSERT (bitmap_count (b, start, cnt, true) == ref_cnt);
+          ASSERT (bitmap_contains (b, start, cnt, true) == (ref_cnt > 0));
+          ASSERT (bitmap_contains (b, start, cnt, false)
+                  == (ref_cnt < cnt));
+        }
+    }
+  bitmap_destroy (b);
+}
+
+/* Marks every bit of B except FREE_CNT randomly chosen ones,
+   leaving them in adjacent pairs so that two-bit requests can be
+   satisfied too. */
+static void
+fill_nearly_full (struct bitmap *b, size_t free_cnt)
+{
+  size_t i;
+
+  bitmap_set_all (b, true);
+  for (i = 0; i < free_cnt; i += 2)
+    {
+      size_t idx = random_ulong () % (bitmap_size (b) - 1);
+      bitmap_set_multiple (b, idx, 2, false);
+    }
+}
+
+/* Times SCAN_CNT allocate-and-free cycles of CNT bits on a
+   BIT_CNT-bit bitmap with about FREE_CNT free bits, first with
+   bitmap_scan() and then with the reference scan. */
+static void
+benchmark (const char *name, size_t bit_cnt, size_t free_cnt, size_t cnt)
+{
+  struct bitmap *b = bitmap_create (bit_cnt);
+  int64_t start;
+  int64_t fast_ticks, ref_ticks;
+  size_t i;
+
+  ASSERT (b != NULL);
+  fill_nearly_full (b, free_cnt);
+
+  start = timer_ticks ();
+  for (i = 0; i < SCAN_CNT; i++)
+    {
+      size_t idx = bitmap_scan_and_flip (b, 0, cnt, false);
+      ASSERT (idx != BITMAP_ERROR);
+      bitmap_set_multiple (b, idx, cnt, false);
+    }
+  fast_ticks = timer_elapsed (start);
+
+  start = timer_ticks ();
+  for (i = 0; i < SCAN_CNT; i++)
+    {
+      size_t idx = reference_scan (b, 0, cnt, false);
+      ASSERT (idx != BITMAP_ERROR);
+      ASSERT (idx == bitmap_scan (b, 0, cnt, false));
+    }
+  ref_ticks = timer_elapsed (start);
+
+  printf ("%s, %zu free bits, %zu-bit scans: %"PRId64" ticks, "
+          "reference %"PRId64" ticks\n",
+          name, bitmap_count (b, 0, bit_cnt, false), cnt,
+          fast_ticks, ref_ticks);
+  bitmap_destroy (b);
+}
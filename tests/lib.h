@@ -2,6 +2,7 @@
 #define TESTS_LIB_H
 
 #include <debug.h>
+#include <rdtsc.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <syscall.h>
@@ -0,0 +1,93 @@
+/* Writes "sample.txt"'s contents to a new file in four
+   asynchronous requests, all in flight at once, then reads them
+   back the same way and checks the completions and the data. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PIECES 4
+
+static struct aio_ring ring;
+
+/* Size of each piece but the last. */
+#define PIECE_SIZE ((sizeof sample - 1 + PIECES - 1) / PIECES)
+
+/* Returns the length of piece I. */
+static size_t
+piece_len (unsigned i) 
+{
+  size_t left = sizeof sample - 1 - i * PIECE_SIZE;
+  return left < PIECE_SIZE ? left : PIECE_SIZE;
+}
+
+/* Queues PIECES requests of OPCODE that together cover the
+   sample, using BUF, submits them, and checks their
+   completions. */
+static void
+run (int fd, int opcode, char *buf) 
+{
+  bool seen[PIECES];
+  int i;
+
+  for (i = 0; i < PIECES; i++) 
+    {
+      struct aio_sqe *sqe = &ring.sq[ring.sq_tail % AIO_RING_SIZE];
+      size_t ofs = i * PIECE_SIZE;
+
+      sqe->opcode = opcode;
+      sqe->fd = fd;
+      sqe->buf = buf + ofs;
+      sqe->len = piece_len (i);
+      sqe->offset = ofs;
+      sqe->user_data = i;
+      ring.sq_tail++;
+      seen[i] = false;
+    }
+
+  i = aio_enter (PIECES);
+  if (i != PIECES)
+    fail ("aio_enter() returned %d instead of %d", i, PIECES);
+  if (ring.sq_head != ring.sq_tail)
+    fail ("aio_enter() left %u requests queued", ring.sq_tail - ring.sq_head);
+
+  while (ring.cq_head != ring.cq_tail) 
+    {
+      struct aio_cqe *cqe = &ring.cq[ring.cq_head++ % AIO_RING_SIZE];
+
+      if (cqe->user_data >= PIECES || seen[cqe->user_data])
+        fail ("unexpected completion %u", cqe->user_data);
+      seen[cqe->user_data] = true;
+      if (cqe->res != (int) piece_len (cqe->user_data))
+        fail ("request %u returned %d instead of %zu",
+              cqe->user_data, cqe->res, piece_len (cqe->user_data));
+    }
+  for (i = 0; i < PIECES; i++)
+    if (!seen[i])
+      fail ("no completion for request %d", i);
+}
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  int handle;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+  CHECK (aio_setup (&ring) == 0, "aio_setup");
+
+  msg ("write %d pieces", PIECES);
+  memcpy (buf, sample, sizeof buf);
+  run (handle, AIO_WRITE, buf);
+
+  msg ("read %d pieces", PIECES);
+  memset (buf, 0, sizeof buf);
+  run (handle, AIO_READ, buf);
+  if (memcmp (buf, sample, sizeof sample - 1))
+    fail ("read wrong data");
+
+  check_file_handle (handle, "test.txt", sample, sizeof sample - 1);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(aio-rw) begin
+(aio-rw) create "test.txt"
+(aio-rw) open "test.txt"
+(aio-rw) aio_setup
+(aio-rw) write 4 pieces
+(aio-rw) read 4 pieces
+(aio-rw) verified contents of "test.txt"
+(aio-rw) end
+aio-rw: exit(0)
+EOF
+pass;
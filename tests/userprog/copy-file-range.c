@@ -0,0 +1,52 @@
+/* Copies "sample.txt" into a new file with copy_file_range(),
+   rotated by 10 bytes, and checks the copy and the file
+   positions. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char expected[sizeof sample - 1];
+  int in, out, byte_cnt;
+
+  CHECK ((in = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (create ("copy.txt", 0), "create \"copy.txt\"");
+  CHECK ((out = open ("copy.txt")) > 1, "open \"copy.txt\"");
+
+  msg ("copy_file_range from offset 10");
+  seek (in, 10);
+  byte_cnt = copy_file_range (in, out, 1000);
+  if (byte_cnt != sizeof sample - 1 - 10)
+    fail ("copy_file_range() returned %d instead of %zu",
+          byte_cnt, sizeof sample - 1 - 10);
+  if (tell (in) != sizeof sample - 1)
+    fail ("copy_file_range() moved input position to %u", tell (in));
+  if (tell (out) != sizeof sample - 1 - 10)
+    fail ("copy_file_range() moved output position to %u", tell (out));
+
+  msg ("copy_file_range the first 10 bytes to the end");
+  seek (in, 0);
+  byte_cnt = copy_file_range (in, out, 10);
+  if (byte_cnt != 10)
+    fail ("copy_file_range() returned %d instead of 10", byte_cnt);
+
+  msg ("copy_file_range at end of input");
+  byte_cnt = copy_file_range (out, in, 10);
+  if (byte_cnt != 0)
+    fail ("copy_file_range() returned %d instead of 0", byte_cnt);
+
+  msg ("copy_file_range from bad fd");
+  byte_cnt = copy_file_range (0x20101234, out, 10);
+  if (byte_cnt != -1)
+    fail ("copy_file_range() returned %d instead of -1", byte_cnt);
+
+  memcpy (expected, sample + 10, sizeof sample - 1 - 10);
+  memcpy (expected + sizeof sample - 1 - 10, sample, 10);
+  seek (out, 0);
+  check_file_handle (out, "copy.txt", expected, sizeof expected);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-file-range) begin
+(copy-file-range) open "sample.txt"
+(copy-file-range) create "copy.txt"
+(copy-file-range) open "copy.txt"
+(copy-file-range) copy_file_range from offset 10
+(copy-file-range) copy_file_range the first 10 bytes to the end
+(copy-file-range) copy_file_range at end of input
+(copy-file-range) copy_file_range from bad fd
+(copy-file-range) verified contents of "copy.txt"
+(copy-file-range) end
+copy-file-range: exit(0)
+EOF
+pass;
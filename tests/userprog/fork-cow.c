@@ -0,0 +1,78 @@
+/* Forks several children that each check and then change their
+   copies of a global array, a stack variable, and the position of
+   a file opened before the fork, while the parent changes its own
+   copies of the array and the variable, and checks that no process
+   sees another's changes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 3
+
+/* Spans several pages of the data segment. */
+static char data[4096 * 3];
+
+/* Fails unless every byte of data[] is C. */
+static void
+check_data (char c)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof data; i++)
+    if (data[i] != c)
+      fail ("data[%zu] is '%c' instead of '%c'", i, data[i], c);
+}
+
+void
+test_main (void)
+{
+  pid_t pids[CHILD_CNT];
+  char buf[10];
+  int local = 1;
+  int handle;
+  int i;
+
+  memset (data, 'a', sizeof data);
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  if (read (handle, buf, sizeof buf) != sizeof buf)
+    fail ("read \"sample.txt\" failed");
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      pids[i] = fork ();
+      if (pids[i] == 0)
+        {
+          /* The parent may already have written its copies. */
+          check_data ('a');
+          if (local != 1)
+            fail ("child %d sees local = %d", i, local);
+          memset (data, 'b' + i, sizeof data);
+          local = 2 + i;
+          check_data ('b' + i);
+          if (read (handle, buf, sizeof buf) != sizeof buf
+              || memcmp (buf, sample + 10, sizeof buf))
+            fail ("child %d read wrong data from \"sample.txt\"", i);
+          exit (81 + i);
+        }
+      if (pids[i] < 0)
+        fail ("fork failed");
+    }
+  msg ("forked %d children", CHILD_CNT);
+
+  memset (data, 'p', sizeof data);
+  local = 0;
+  check_data ('p');
+  msg ("parent changed its copies");
+
+  for (i = 0; i < CHILD_CNT; i++)
+    CHECK (wait (pids[i]) == 81 + i, "wait for child %d", i);
+  check_data ('p');
+  if (local != 0)
+    fail ("parent sees local = %d", local);
+  if (tell (handle) != sizeof buf)
+    fail ("a child moved parent's position to %u", tell (handle));
+  msg ("parent's copies unchanged");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-cow) begin
+(fork-cow) open "sample.txt"
+(fork-cow) forked 3 children
+(fork-cow) parent changed its copies
+(fork-cow) wait for child 0
+(fork-cow) wait for child 1
+(fork-cow) wait for child 2
+(fork-cow) parent's copies unchanged
+(fork-cow) end
+EOF
+pass;
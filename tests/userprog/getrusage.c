@@ -0,0 +1,50 @@
+/* Checks that getrusage() counts the calling process's reads,
+   page faults, and resident frames, and counts a child's usage
+   only once the child has been waited for. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Large enough that load() does not map all of it up front. */
+static char big[64 * 4096];
+
+void
+test_main (void)
+{
+  struct rusage self, children;
+  char buf[sizeof sample - 1];
+  size_t i;
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  if (read (handle, buf, sizeof buf) != (int) sizeof buf)
+    fail ("read \"sample.txt\" failed");
+  for (i = sizeof big / 2; i < sizeof big; i += 4096)
+    big[i] = 1;
+
+  if (getrusage (RUSAGE_SELF, &self) != 0)
+    fail ("getrusage (RUSAGE_SELF) failed");
+  if (self.read_bytes < (int64_t) sizeof buf)
+    fail ("read_bytes is %lld", self.read_bytes);
+  if (self.minflt + self.majflt < sizeof big / 2 / 4096)
+    fail ("only %u page faults", self.minflt + self.majflt);
+  if (self.maxrss < sizeof big / 2 / 4096)
+    fail ("maxrss is only %u", self.maxrss);
+  msg ("own usage counted");
+
+  if (getrusage (RUSAGE_CHILDREN, &children) != 0)
+    fail ("getrusage (RUSAGE_CHILDREN) failed");
+  if (children.maxrss != 0 || children.write_bytes != 0)
+    fail ("usage of children before any exited");
+  msg ("wait(exec()) = %d", wait (exec ("child-simple")));
+  if (getrusage (RUSAGE_CHILDREN, &children) != 0)
+    fail ("getrusage (RUSAGE_CHILDREN) failed");
+  if (children.maxrss == 0 || children.write_bytes == 0)
+    fail ("child's usage not counted");
+  msg ("child's usage counted");
+
+  if (getrusage (2, &self) != -1)
+    fail ("getrusage (2) succeeded");
+}
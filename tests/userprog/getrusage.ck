@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(getrusage) begin
+(getrusage) open "sample.txt"
+(getrusage) own usage counted
+(child-simple) run
+child-simple: exit(81)
+(getrusage) wait(exec()) = 81
+(getrusage) child's usage counted
+(getrusage) end
+getrusage: exit(0)
+EOF
+pass;
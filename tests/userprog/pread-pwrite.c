@@ -0,0 +1,47 @@
+/* Reads and writes a file at explicit offsets and checks that
+   neither moves the file position. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[32];
+  int handle, byte_cnt;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  msg ("pwrite second half, then first half");
+  byte_cnt = pwrite (handle, sample + 16, sizeof sample - 1 - 16, 16);
+  if (byte_cnt != sizeof sample - 1 - 16)
+    fail ("pwrite() returned %d instead of %zu",
+          byte_cnt, sizeof sample - 1 - 16);
+  byte_cnt = pwrite (handle, sample, 16, 0);
+  if (byte_cnt != 16)
+    fail ("pwrite() returned %d instead of 16", byte_cnt);
+  if (tell (handle) != 0)
+    fail ("pwrite() moved file position to %u", tell (handle));
+
+  msg ("pread at offset 10");
+  seek (handle, 3);
+  byte_cnt = pread (handle, buf, sizeof buf, 10);
+  if (byte_cnt != sizeof buf)
+    fail ("pread() returned %d instead of %zu", byte_cnt, sizeof buf);
+  if (memcmp (buf, sample + 10, sizeof buf))
+    fail ("pread() returned wrong data");
+  if (tell (handle) != 3)
+    fail ("pread() moved file position to %u", tell (handle));
+
+  msg ("pread past end of file");
+  byte_cnt = pread (handle, buf, sizeof buf, sizeof sample + 100);
+  if (byte_cnt != 0)
+    fail ("pread() returned %d instead of 0", byte_cnt);
+
+  seek (handle, 0);
+  check_file_handle (handle, "test.txt", sample, sizeof sample - 1);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) create "test.txt"
+(pread-pwrite) open "test.txt"
+(pread-pwrite) pwrite second half, then first half
+(pread-pwrite) pread at offset 10
+(pread-pwrite) pread past end of file
+(pread-pwrite) verified contents of "test.txt"
+(pread-pwrite) end
+pread-pwrite: exit(0)
+EOF
+pass;
@@ -0,0 +1,46 @@
+/* Gathers a file's contents from several buffers with writev()
+   and scatters them back into several buffers with readv(). */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static char buf[sizeof sample];
+  struct iovec iov[3];
+  int handle, byte_cnt;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  msg ("writev three pieces");
+  iov[0].iov_base = sample;
+  iov[0].iov_len = 7;
+  iov[1].iov_base = sample + 7;
+  iov[1].iov_len = 0;
+  iov[2].iov_base = sample + 7;
+  iov[2].iov_len = sizeof sample - 1 - 7;
+  byte_cnt = writev (handle, iov, 3);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("writev() returned %d instead of %zu", byte_cnt, sizeof sample - 1);
+
+  msg ("readv two pieces");
+  seek (handle, 0);
+  iov[0].iov_base = buf + 100;
+  iov[0].iov_len = sizeof sample - 1 - 100;
+  iov[1].iov_base = buf;
+  iov[1].iov_len = 100;
+  byte_cnt = readv (handle, iov, 2);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("readv() returned %d instead of %zu", byte_cnt, sizeof sample - 1);
+  if (memcmp (buf + 100, sample, sizeof sample - 1 - 100)
+      || memcmp (buf, sample + sizeof sample - 1 - 100, 100))
+    fail ("readv() returned wrong data");
+
+  seek (handle, 0);
+  check_file_handle (handle, "test.txt", sample, sizeof sample - 1);
+}
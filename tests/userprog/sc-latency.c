@@ -0,0 +1,40 @@
+/* Microbenchmark for the cost of a system call trap.
+
+   Times many calls of isdir() on the console, which returns
+   false before touching any file system state, so that what is
+   measured is the trap itself, the argument copy and the
+   dispatch.  Reports the fastest call and the average, in time
+   stamp counter cycles, so the per-trap overhead can be tracked
+   as the system call layer changes. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CALL_CNT 10000
+
+void
+test_main (void)
+{
+  uint64_t start, min = UINT64_MAX, total;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < CALL_CNT; i++)
+    {
+      uint64_t call_start = rdtsc ();
+      uint64_t cycles;
+      if (isdir (STDIN_FILENO))
+        fail ("isdir(STDIN_FILENO) returned true");
+      cycles = rdtsc () - call_start;
+      if (cycles < min)
+        min = cycles;
+    }
+  total = rdtsc () - start;
+
+  msg ("%d null system calls: fastest %"PRIu64" cycles, "
+       "average %"PRIu64" cycles",
+       CALL_CNT, min, total / CALL_CNT);
+}
@@ -0,0 +1,98 @@
+/* Spawns several threads that add to a shared counter under a
+   lock built on futex_wait() and futex_wake(), then joins them,
+   checking the total, each thread's return value, and that a
+   thread cannot be joined twice. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define ITER_CNT 1000
+
+/* 0 if free, 1 if held, 2 if held and threads may be waiting. */
+static int lock;
+static int counter;
+
+/* Set by the last thread to finish its additions. */
+static int done;
+static int finished;
+
+static void
+acquire (void)
+{
+  int c = __sync_val_compare_and_swap (&lock, 0, 1);
+  if (c != 0)
+    {
+      if (c != 2)
+        c = __sync_lock_test_and_set (&lock, 2);
+      while (c != 0)
+        {
+          futex_wait (&lock, 2);
+          c = __sync_lock_test_and_set (&lock, 2);
+        }
+    }
+}
+
+static void
+release (void)
+{
+  if (__sync_fetch_and_sub (&lock, 1) != 1)
+    {
+      lock = 0;
+      futex_wake (&lock, 1);
+    }
+}
+
+static int
+add (void *aux)
+{
+  int id = (int) aux;
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      acquire ();
+      counter++;
+      release ();
+    }
+
+  acquire ();
+  if (++finished == THREAD_CNT)
+    {
+      done = 1;
+      futex_wake (&done, THREAD_CNT);
+    }
+  release ();
+  return 10 + id;
+}
+
+void
+test_main (void) 
+{
+  thrid_t tids[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      tids[i] = thread_spawn (add, (void *) i);
+      if (tids[i] == THRID_ERROR)
+        fail ("thread_spawn failed");
+    }
+  msg ("spawned %d threads", THREAD_CNT);
+
+  while (done == 0)
+    futex_wait (&done, 0);
+  msg ("woken by the last thread");
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      int status = thread_join (tids[i]);
+      if (status != 10 + i)
+        fail ("thread %d returned %d, expected %d", tids[i], status, 10 + i);
+    }
+  msg ("joined %d threads", THREAD_CNT);
+
+  CHECK (counter == THREAD_CNT * ITER_CNT, "counter is %d", counter);
+  CHECK (thread_join (tids[0]) == -1, "join a joined thread");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-spawn) begin
+(thread-spawn) spawned 4 threads
+(thread-spawn) woken by the last thread
+(thread-spawn) joined 4 threads
+(thread-spawn) counter is 4000
+(thread-spawn) join a joined thread
+(thread-spawn) end
+thread-spawn: exit(0)
+EOF
+pass;
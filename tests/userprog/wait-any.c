@@ -0,0 +1,48 @@
+/* Forks several children that exit with different statuses and
+   reaps them with wait_any(), checking that each comes back once,
+   with its own status, and that wait_any() fails when no children
+   are left. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+
+void
+test_main (void) 
+{
+  pid_t pids[CHILD_CNT];
+  bool reaped[CHILD_CNT];
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      pids[i] = fork ();
+      if (pids[i] == 0)
+        exit (10 + i);
+      if (pids[i] < 0)
+        fail ("fork failed");
+      reaped[i] = false;
+    }
+  msg ("forked %d children", CHILD_CNT);
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      int status, j;
+      pid_t pid = wait_any (&status);
+
+      for (j = 0; j < CHILD_CNT; j++)
+        if (pids[j] == pid)
+          break;
+      if (j == CHILD_CNT || reaped[j])
+        fail ("wait_any() returned unexpected pid %d", pid);
+      if (status != 10 + j)
+        fail ("child %d exited with %d, expected %d", pid, status, 10 + j);
+      reaped[j] = true;
+    }
+  msg ("reaped %d children", CHILD_CNT);
+
+  CHECK (wait_any (NULL) == -1, "wait_any() with no children");
+  CHECK (wait (pids[0]) == -1, "wait() on a reaped child");
+}
@@ -0,0 +1,59 @@
+/* Forks children that share a 2 MB array copy-on-write with the
+   parent, more than fits in memory alongside their own copies, so
+   that shared pages are evicted to swap and read back in.  Every
+   process checks the array, then changes its own copy, and none
+   may see another's changes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+#define CHILD_CNT 2
+
+static char buf[SIZE];
+
+/* Fails unless every byte of buf[] is C. */
+static void
+check_buf (char c)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != c)
+      fail ("byte %zu is '%c' instead of '%c'", i, buf[i], c);
+}
+
+void
+test_main (void)
+{
+  pid_t pids[CHILD_CNT];
+  int i;
+
+  memset (buf, 'a', sizeof buf);
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      pids[i] = fork ();
+      if (pids[i] == 0)
+        {
+          check_buf ('a');
+          memset (buf, 'b' + i, sizeof buf);
+          check_buf ('b' + i);
+          exit (0x42 + i);
+        }
+      if (pids[i] < 0)
+        fail ("fork failed");
+    }
+  msg ("forked %d children", CHILD_CNT);
+
+  check_buf ('a');
+  memset (buf, 'p', sizeof buf);
+  check_buf ('p');
+  msg ("parent changed its copy");
+
+  for (i = 0; i < CHILD_CNT; i++)
+    CHECK (wait (pids[i]) == 0x42 + i, "wait for child %d", i);
+  check_buf ('p');
+  msg ("parent's copy unchanged");
+}
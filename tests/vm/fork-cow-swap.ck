@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-cow-swap) begin
+(fork-cow-swap) forked 2 children
+(fork-cow-swap) parent changed its copy
+(fork-cow-swap) wait for child 0
+(fork-cow-swap) wait for child 1
+(fork-cow-swap) parent's copy unchanged
+(fork-cow-swap) end
+EOF
+pass;
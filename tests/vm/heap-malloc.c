@@ -0,0 +1,72 @@
+/* Allocates many small blocks and one 1 MB block with malloc(),
+   fills and checks them, frees them, and verifies that the break
+   ends up back where it started and that it cannot be lowered
+   below the start of the heap. */
+
+#include <malloc.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 512
+#define BIG_SIZE (1024 * 1024)
+
+static char *blocks[BLOCK_CNT];
+
+/* Size of the Ith small block: 1 to 1500 bytes, covering every
+   size class and some big blocks. */
+static size_t
+block_size (int i)
+{
+  return 1 + (i * 37) % 1500;
+}
+
+void
+test_main (void)
+{
+  void *start = sbrk (0);
+  char *big;
+  size_t j;
+  int i;
+
+  msg ("allocate small blocks");
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      blocks[i] = malloc (block_size (i));
+      if (blocks[i] == NULL)
+        fail ("malloc(%zu) failed", block_size (i));
+      memset (blocks[i], i, block_size (i));
+    }
+
+  msg ("allocate big block");
+  big = calloc (BIG_SIZE, 1);
+  if (big == NULL)
+    fail ("calloc(%d, 1) failed", BIG_SIZE);
+  for (j = 0; j < BIG_SIZE; j++)
+    if (big[j] != 0)
+      fail ("big[%zu] == %d, not zero", j, big[j]);
+  for (j = 0; j < BIG_SIZE; j += 4096)
+    big[j] = j / 4096;
+
+  msg ("check small blocks");
+  for (i = 0; i < BLOCK_CNT; i++)
+    for (j = 0; j < block_size (i); j++)
+      if (blocks[i][j] != (char) i)
+        fail ("block %d byte %zu changed", i, j);
+
+  msg ("check big block");
+  for (j = 0; j < BIG_SIZE; j += 4096)
+    if (big[j] != (char) (j / 4096))
+      fail ("big[%zu] changed", j);
+
+  msg ("free everything");
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+  free (big);
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+
+  CHECK (sbrk (0) == start, "break back at start");
+  CHECK (sbrk (-4096) == (void *) -1, "sbrk below heap start fails");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(heap-malloc) begin
+(heap-malloc) allocate small blocks
+(heap-malloc) allocate big block
+(heap-malloc) check small blocks
+(heap-malloc) check big block
+(heap-malloc) free everything
+(heap-malloc) break back at start
+(heap-malloc) sbrk below heap start fails
+(heap-malloc) end
+EOF
+pass;
@@ -0,0 +1,55 @@
+/* Maps 2 MB of anonymous memory, more than fits in physical
+   memory, and checks that it starts out zeroed and keeps what is
+   written to it through eviction.  Then unmaps it, maps the same
+   range again, and checks that the old contents are gone. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/arc4.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define SIZE (2 * 1024 * 1024)
+
+/* Fails unless all SIZE bytes at ACTUAL are zero. */
+static void
+check_zero (void)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (ACTUAL[i] != 0)
+      fail ("byte %zu is %d, not zero", i, ACTUAL[i]);
+}
+
+void
+test_main (void)
+{
+  struct arc4 arc4;
+  mapid_t map;
+  size_t i;
+
+  CHECK ((map = mmap_anon (ACTUAL, SIZE)) != MAP_FAILED, "mmap_anon");
+  msg ("check zeros");
+  check_zero ();
+
+  msg ("write pattern");
+  for (i = 0; i < SIZE; i++)
+    ACTUAL[i] = i % 251;
+  arc4_init (&arc4, "foobar", 6);
+  arc4_crypt (&arc4, ACTUAL, SIZE);
+  arc4_init (&arc4, "foobar", 6);
+  arc4_crypt (&arc4, ACTUAL, SIZE);
+
+  msg ("check pattern");
+  for (i = 0; i < SIZE; i++)
+    if (ACTUAL[i] != (char) (i % 251))
+      fail ("byte %zu is %d, not %d", i, ACTUAL[i], (int) (i % 251));
+
+  munmap (map);
+  CHECK ((map = mmap_anon (ACTUAL, SIZE)) != MAP_FAILED, "mmap_anon again");
+  msg ("check zeros");
+  check_zero ();
+  munmap (map);
+}
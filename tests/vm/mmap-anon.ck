@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-anon) begin
+(mmap-anon) mmap_anon
+(mmap-anon) check zeros
+(mmap-anon) write pattern
+(mmap-anon) check pattern
+(mmap-anon) mmap_anon again
+(mmap-anon) check zeros
+(mmap-anon) end
+EOF
+pass;
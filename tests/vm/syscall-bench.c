@@ -0,0 +1,64 @@
+/* Microbenchmark for the read and write system calls.
+
+   Moves 1 MB through a file in chunks of 4 kB up to 1 MB and
+   reports the cycles spent per kilobyte, as measured by the time
+   stamp counter.  The kernel copies user buffers a page at a time
+   with copy_from_user() and copy_to_user(), without checking
+   each byte first, so the cost per kilobyte should fall as the
+   chunks grow and the fixed cost of each call is spread wider. */
+
+#include <inttypes.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TOTAL (1024 * 1024)
+
+static char buf[TOTAL];
+
+/* Moves TOTAL bytes through FD in CHUNK-byte system calls,
+   reading if READING, otherwise writing, and returns the number
+   of cycles taken. */
+static uint64_t
+run (int fd, size_t chunk, bool reading)
+{
+  uint64_t start;
+  size_t ofs;
+
+  seek (fd, 0);
+  start = rdtsc ();
+  for (ofs = 0; ofs < TOTAL; ofs += chunk)
+    {
+      int bytes = (reading
+                   ? read (fd, buf + ofs, chunk)
+                   : write (fd, buf + ofs, chunk));
+      if (bytes != (int) chunk)
+        fail ("%s of %zu bytes at offset %zu returned %d",
+              reading ? "read" : "write", chunk, ofs, bytes);
+    }
+  return rdtsc () - start;
+}
+
+void
+test_main (void)
+{
+  size_t chunk;
+  int fd;
+
+  memset (buf, 0x5a, sizeof buf);
+  CHECK (create ("bench", TOTAL), "create \"bench\"");
+  CHECK ((fd = open ("bench")) > 1, "open \"bench\"");
+
+  for (chunk = 4 * 1024; chunk <= TOTAL; chunk *= 4)
+    {
+      uint64_t write_cycles = run (fd, chunk, false);
+      uint64_t read_cycles = run (fd, chunk, true);
+      msg ("%4zu kB chunks: write %"PRIu64" cycles/kB, "
+           "read %"PRIu64" cycles/kB",
+           chunk / 1024, write_cycles / (TOTAL / 1024),
+           read_cycles / (TOTAL / 1024));
+    }
+
+  close (fd);
+}
@@ -22,6 +22,7 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "vm/share.h"
 #include "vm/swap.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -35,6 +36,7 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/defrag.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -46,6 +48,9 @@ uint32_t *init_page_dir;
 /* -f: Format the file system? */
 static bool format_filesys;
 
+/* -defrag: Run the background defragmenter? */
+static bool background_defrag;
+
 /* -filesys, -scratch, -swap: Names of block devices to use,
    overriding the defaults. */
 static const char *filesys_bdev_name;
@@ -114,6 +119,7 @@ main (void)
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  process_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
@@ -126,6 +132,8 @@ main (void)
   ide_init ();
   locate_block_devices ();
   filesys_init (format_filesys);
+  if (background_defrag)
+    defrag_init ();
 #endif
 
   printf ("Boot complete.\n");
@@ -244,6 +252,8 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-defrag"))
+        background_defrag = true;
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
@@ -260,6 +270,8 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-sysstats"))
+        syscall_print_stats_enabled = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -316,6 +328,7 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"defrag", 2, fsutil_defrag},
 #endif
       {NULL, 0, NULL},
     };
@@ -362,6 +375,7 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  defrag FILE        Make FILE's data contiguous on disk.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -372,6 +386,7 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -defrag            Defragment files in the background.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
@@ -382,6 +397,7 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -sysstats          Print system call statistics at exit.\n"
 #endif
           );
   shutdown_power_off ();
@@ -397,6 +413,7 @@ locate_block_devices (void)
 #ifdef VM
   locate_block_device (BLOCK_SWAP, swap_bdev_name);
   swap_init();
+  share_init();
 #endif
 }
 
@@ -386,6 +386,16 @@ intr_handler (struct intr_frame *frame)
       if (yield_on_return) 
         thread_yield (); 
     }
+
+#ifdef USERPROG
+  /* A thread on its way back to a process that is exiting exits
+     instead. */
+  if ((frame->cs & 3) == 3 && thread_current ()->process->exiting)
+    {
+      intr_enable ();
+      thread_exit ();
+    }
+#endif
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
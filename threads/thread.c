@@ -24,7 +24,6 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-#define MIN_FD 2
 #define NO_PARENT -1
 
 /* List of processes in THREAD_READY state, that is, processes
@@ -35,6 +34,12 @@ static struct list ready_list;
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
+/* Threads that have not yet exited, hashed by tid so that
+   thread_get() need not walk all_list.  Like all_list, only
+   touched with interrupts off. */
+#define TID_BUCKETS 64
+static struct list tid_table[TID_BUCKETS];
+
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -94,19 +99,26 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  size_t i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
   list_init (&ready_list);
   list_init (&all_list);
+  for (i = 0; i < TID_BUCKETS; i++)
+    list_init (&tid_table[i]);
 
   frame_table_init();
+  child_init();
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  list_push_back (&tid_table[initial_thread->tid % TID_BUCKETS],
+                  &initial_thread->tidelem);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -126,10 +138,11 @@ thread_start (void)
   sema_down (&idle_started);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
+/* Called by the timer interrupt handler at each timer tick, with
+   USER true if the tick interrupted user code.
    Thus, this function runs in an external interrupt context. */
 void
-thread_tick (void) 
+thread_tick (bool user) 
 {
   struct thread *t = thread_current ();
 
@@ -143,6 +156,17 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+#ifdef USERPROG
+  /* Charge the tick to the process. */
+  if (t->pagedir != NULL)
+    {
+      if (user)
+        t->rusage.utime++;
+      else
+        t->rusage.stime++;
+    }
+#endif
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
@@ -197,6 +221,7 @@ thread_create (const char *name, int priority,
      Do this atomically so intermediate values for the 'stack' 
      member cannot be observed. */
   old_level = intr_disable ();
+  list_push_back (&tid_table[tid % TID_BUCKETS], &t->tidelem);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -215,14 +240,10 @@ thread_create (const char *name, int priority,
 
   intr_set_level (old_level);
 
-  // Add child process to child list
+  // process_execute() and process_fork() give a child process
+  // its record in the parent's children; other threads have none
   t->parent = thread_tid();
-  if(thread_current()->cudir != NULL)
-	t->cudir = dir_reopen(thread_current()->cudir);
-  else
-	t->cudir = NULL;
-  struct child_process *cp = add_child_process(t->tid);
-  t->cp = cp;
+  t->cudir = process_reopen_cwd();
 
   /* Add to run queue. */
   thread_unblock (t);
@@ -294,6 +315,28 @@ thread_current (void)
   return t;
 }
 
+/* Returns the thread that owns the running thread's process:
+   itself, unless it was made by thread_spawn(). */
+struct thread *
+process_current (void)
+{
+  return thread_current ()->process;
+}
+
+/* Returns a new handle on the current process's working
+   directory, or a null pointer if it is the root. */
+struct dir *
+process_reopen_cwd (void)
+{
+  struct thread *p = process_current ();
+  struct dir *dir;
+
+  lock_acquire (&p->files_lock);
+  dir = p->cudir != NULL ? dir_reopen (p->cudir) : NULL;
+  lock_release (&p->files_lock);
+  return dir;
+}
+
 /* Returns the running thread's tid. */
 tid_t
 thread_tid (void) 
@@ -318,6 +361,7 @@ thread_exit (void)
   intr_disable ();
   release_locks();
   list_remove (&thread_current()->allelem);
+  list_remove (&thread_current()->tidelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -494,16 +538,29 @@ init_thread (struct thread *t, const char *name, int priority)
 
   list_init(&t->lock_list);
 
-  list_init(&t->file_list);
+  t->files = NULL;
+  t->file_cnt = 0;
   t->fd = MIN_FD;
 
   list_init(&t->mmap_list);
   t->mapid = 0;
 
-  list_init(&t->child_list);
+  t->children_ready = false;
+  list_init(&t->exited_children);
+  cond_init(&t->child_exited);
   t->cp = NULL;
   t->parent = NO_PARENT;
   t->cudir = NULL;
+
+  t->process = t;
+  t->uthread = NULL;
+  lock_init(&t->vm_lock);
+  lock_init(&t->files_lock);
+  list_init(&t->uthreads);
+  t->uthread_cnt = 0;
+  t->stack_slots = 0;
+  t->exiting = false;
+  cond_init(&t->uthread_changed);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -620,20 +677,35 @@ allocate_tid (void)
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
-bool thread_alive (int pid)
+/* Returns the thread whose tid is TID, or a null pointer if it
+   has exited or never existed.  The thread may exit as soon as
+   interrupts are back on, so callers that dereference the result
+   need some other guarantee that it is still alive. */
+struct thread *
+thread_get (tid_t tid)
 {
+  struct list *bucket = &tid_table[(unsigned) tid % TID_BUCKETS];
+  struct thread *found = NULL;
   struct list_elem *e;
+  enum intr_level old_level;
 
-  for (e = list_begin (&all_list); e != list_end (&all_list);
-       e = list_next (e))
+  old_level = intr_disable ();
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e))
     {
-      struct thread *t = list_entry (e, struct thread, allelem);
-      if (t->tid == pid)
-	{
-	  return true;
-	}
+      struct thread *t = list_entry (e, struct thread, tidelem);
+      if (t->tid == tid)
+        {
+          found = t;
+          break;
+        }
     }
-  return false;
+  intr_set_level (old_level);
+  return found;
+}
+
+bool thread_alive (int pid)
+{
+  return thread_get (pid) != NULL;
 }
 
 void release_locks (void)
@@ -4,7 +4,9 @@
 #include <debug.h>
 #include <list.h>
 #include <hash.h>
+#include <rusage.h>
 #include <stdint.h>
+#include "threads/synch.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -25,6 +27,10 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Lowest file descriptor handed out for files; 0 and 1 are the
+   console. */
+#define MIN_FD 2
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -90,6 +96,7 @@ struct thread
     uint8_t *stack;                     /* Saved stack pointer. */
     int priority;                       /* Priority. */
     struct list_elem allelem;           /* List element for all threads list. */
+    struct list_elem tidelem;           /* List element for tid table. */
 
     /* Save wakeup time for sleeping thread */
     int64_t wakeup_tick;  
@@ -108,16 +115,29 @@ struct thread
     // Needed to keep track of locks thread holds
     struct list lock_list;
 
-    // Needed for file system sys calls
-    struct list file_list;
-    int fd;
-
-    // Needed for wait / exec sys calls
-    struct list child_list;
+    // Needed for file system sys calls: table indexed by fd
+    struct process_file **files;
+    int file_cnt;                       // Number of slots in files
+    int fd;                             // No free slot below this fd
+
+    // Needed for wait / exec sys calls: children by pid, the ones
+    // that exited but were not yet waited for, and a condition
+    // broadcast when one exits, all guarded by child_lock
+    struct hash children;
+    bool children_ready;		// Whether children is initialized
+    struct list exited_children;
+    struct condition child_exited;
     tid_t parent;
-    // Points to child_process struct in parent's child list
+    // Points to child_process struct in parent's children table
     struct child_process* cp;
 
+    // Needed for sbrk: the bottom of the heap, just above the
+    // executable, and the current break
+    uint8_t *heap_start;
+    uint8_t *brk;
+    // Pages in anonymous mappings, guarded by vm_lock
+    unsigned anon_pages;
+
     // Needed for denying writes to executables
     struct file* executable;
     struct dir *cudir;	//save current directory
@@ -125,6 +145,48 @@ struct thread
 
     struct list mmap_list;
     int mapid;
+
+    // User stack pointer on entry to the current system call
+    void *esp;
+    // Interrupt frame of the current system call, for fork()
+    struct intr_frame *frame;
+
+    // Per-process system call statistics, indexed by number,
+    // counting all of the process's threads; owner only
+    struct sysstat *sysstats;
+
+    // Asynchronous I/O state, if aio_setup() was called
+    struct aio_context *aio;
+
+    // Resource usage of this process, and of the children it has
+    // waited for
+    struct rusage rusage;
+    struct rusage child_rusage;
+    unsigned frame_cnt;                 // Frames resident now
+    unsigned page_reads;                // Pages read from files or swap
+
+    // Needed for threads within a process: the thread that owns
+    // the process's files, memory, and exit status, which is the
+    // thread itself unless thread_spawn() made it.  Children and
+    // their exit status are still kept per thread, in children
+    // above.  The fields below are used in the owner only.
+    struct thread *process;
+    struct uthread *uthread;		// Own record, if spawned
+    // Guards spt, mmap_list, and the heap against the process's
+    // other threads; held by the page fault handler
+    struct lock vm_lock;
+    // Guards files, fd, cudir, and the reference counts of the
+    // open files; held only to look up or change them
+    struct lock files_lock;
+    // Spawned threads, their number still running, the stack
+    // slots in use, whether the process is exiting, and a
+    // condition broadcast when one of them exits, all guarded by
+    // uthread_lock
+    struct list uthreads;
+    int uthread_cnt;
+    unsigned stack_slots;
+    bool exiting;
+    struct condition uthread_changed;
   };
 
 /* If false (default), use round-robin scheduler.
@@ -135,7 +197,7 @@ extern bool thread_mlfqs;
 void thread_init (void);
 void thread_start (void);
 
-void thread_tick (void);
+void thread_tick (bool user);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -145,6 +207,8 @@ void thread_block (void);
 void thread_unblock (struct thread *);
 
 struct thread *thread_current (void);
+struct thread *process_current (void);
+struct dir *process_reopen_cwd (void);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
@@ -163,6 +227,7 @@ void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
+struct thread *thread_get (tid_t);
 bool thread_alive (int pid);
 void release_locks (void);
 
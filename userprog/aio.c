@@ -0,0 +1,421 @@
+#include "userprog/aio.h"
+#include <list.h>
+#include <stdint.h>
+#include <user/syscall.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#include "userprog/usercopy.h"
+
+/* Asynchronous I/O.
+
+   The rings live in the process's own memory, so the kernel only
+   touches them from the process, inside aio_setup() and
+   aio_enter(), with copy_from_user() and copy_to_user().  There
+   the requests are taken off the submission queue, write data is
+   copied into a kernel buffer, and the requests go on a queue
+   served by a pool of worker threads, which call file_read_at()
+   or file_write_at() on the kernel buffer.  Finished requests
+   come back on the process's done list, and aio_enter() copies
+   read data out and posts the completions.
+
+   The kernel buffers come out of the kernel's heap, so the bytes
+   in flight are limited for each process and for all of them
+   together.  A request that does not fit stays in the submission
+   queue until earlier ones complete. */
+
+/* Number of worker threads. */
+#define AIO_WORKERS 4
+
+/* Most bytes of kernel buffers in flight for one process and for
+   all processes together. */
+#define AIO_PROCESS_BYTES (2 * AIO_MAX_LEN)
+#define AIO_TOTAL_BYTES (4 * AIO_MAX_LEN)
+
+/* A process's asynchronous I/O state. */
+struct aio_context
+  {
+    struct aio_ring *ring;      /* User address of the rings. */
+    unsigned sq_head;           /* Kernel's copy of ring->sq_head. */
+    unsigned cq_tail;           /* Kernel's copy of ring->cq_tail. */
+    int pending;                /* Submitted but not yet posted. */
+    unsigned bytes;             /* Buffer bytes held; work_lock. */
+    struct lock lock;           /* Guards done. */
+    struct condition done_cond; /* Signaled when a request is done. */
+    struct list done;           /* Requests finished by workers. */
+  };
+
+/* One read or write. */
+struct aio_request
+  {
+    struct list_elem elem;      /* In work_queue or context's done. */
+    struct aio_context *ctx;    /* Owning process's context. */
+    int opcode;                 /* AIO_READ or AIO_WRITE. */
+    struct file *file;          /* Reopened, so the fd may be closed. */
+    void *ubuf;                 /* User buffer. */
+    void *kbuf;                 /* Kernel copy of the data. */
+    off_t len;                  /* Bytes to transfer. */
+    off_t offset;               /* File offset. */
+    unsigned user_data;         /* Copied to the completion. */
+    int res;                    /* Result. */
+  };
+
+/* Requests waiting for a worker, and the buffer bytes held by
+   all processes' requests, guarded by work_lock. */
+static struct list work_queue;
+static struct lock work_lock;
+static struct condition work_cond;
+static bool workers_started;
+static unsigned total_bytes;
+
+static void worker (void *aux);
+static int submit (struct aio_context *);
+static void reap (struct aio_context *);
+static void post (struct aio_context *, unsigned user_data, int res);
+static void free_request (struct aio_request *);
+
+/* Initializes the work queue.  The workers start with the first
+   aio_setup(). */
+void
+aio_init (void)
+{
+  list_init (&work_queue);
+  lock_init (&work_lock);
+  cond_init (&work_cond);
+}
+
+/* Registers RING, whose indexes are reset to 0, as the current
+   process's rings.  Returns 0 if successful, -1 if the process
+   already has rings or memory is short. */
+int
+aio_setup (struct aio_ring *ring)
+{
+  static const unsigned zeros[4];
+  struct thread *t = thread_current ();
+  struct aio_context *ctx;
+  int i;
+
+  if (t->aio != NULL)
+    return -1;
+  if (!copy_to_user (ring, zeros, sizeof zeros))
+    exit (-1);
+
+  ctx = malloc (sizeof *ctx);
+  if (ctx == NULL)
+    return -1;
+  ctx->ring = ring;
+  ctx->sq_head = ctx->cq_tail = 0;
+  ctx->pending = 0;
+  ctx->bytes = 0;
+  lock_init (&ctx->lock);
+  cond_init (&ctx->done_cond);
+  list_init (&ctx->done);
+
+  lock_acquire (&work_lock);
+  if (!workers_started)
+    {
+      for (i = 0; i < AIO_WORKERS; i++)
+        thread_create ("aio", PRI_DEFAULT, worker, NULL);
+      workers_started = true;
+    }
+  lock_release (&work_lock);
+
+  t->aio = ctx;
+  return 0;
+}
+
+/* Submits the requests queued in the current process's
+   submission queue, as many as there is room to complete and to
+   buffer, then waits until at least MIN_COMPLETE completions are
+   posted and not yet consumed, or until nothing more is in
+   flight, submitting more as room frees up.  Returns the number
+   of requests submitted, or -1 if the process has no rings or
+   its submission queue is corrupt. */
+int
+aio_enter (unsigned min_complete)
+{
+  struct aio_context *ctx = thread_current ()->aio;
+  int submitted;
+
+  if (ctx == NULL)
+    return -1;
+  submitted = submit (ctx);
+  if (min_complete > AIO_RING_SIZE)
+    min_complete = AIO_RING_SIZE;
+
+  for (;;)
+    {
+      unsigned cq_head;
+
+      reap (ctx);
+      if (submitted >= 0)
+        {
+          int more = submit (ctx);
+          submitted = more < 0 ? more : submitted + more;
+        }
+      if (!copy_from_user (&cq_head, &ctx->ring->cq_head, sizeof cq_head))
+        exit (-1);
+      if (ctx->cq_tail - cq_head >= min_complete || ctx->pending == 0)
+        break;
+
+      lock_acquire (&ctx->lock);
+      while (list_empty (&ctx->done))
+        cond_wait (&ctx->done_cond, &ctx->lock);
+      lock_release (&ctx->lock);
+    }
+  return submitted;
+}
+
+/* Waits for the current process's requests in flight, then frees
+   its asynchronous I/O state.  Called at process exit. */
+void
+aio_exit (void)
+{
+  struct thread *t = thread_current ();
+  struct aio_context *ctx = t->aio;
+
+  if (ctx == NULL)
+    return;
+
+  lock_acquire (&ctx->lock);
+  for (;;)
+    {
+      while (!list_empty (&ctx->done))
+        {
+          free_request (list_entry (list_pop_front (&ctx->done),
+                                    struct aio_request, elem));
+          ctx->pending--;
+        }
+      if (ctx->pending == 0)
+        break;
+      cond_wait (&ctx->done_cond, &ctx->lock);
+    }
+  lock_release (&ctx->lock);
+
+  t->aio = NULL;
+  free (ctx);
+}
+
+/* Worker thread: carries out requests from the work queue and
+   hands them back to their processes. */
+static void
+worker (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct aio_request *r;
+
+      lock_acquire (&work_lock);
+      while (list_empty (&work_queue))
+        cond_wait (&work_cond, &work_lock);
+      r = list_entry (list_pop_front (&work_queue), struct aio_request, elem);
+      lock_release (&work_lock);
+
+      if (r->opcode == AIO_READ)
+        r->res = file_read_at (r->file, r->kbuf, r->len, r->offset);
+      else
+        r->res = file_write_at (r->file, r->kbuf, r->len, r->offset);
+
+      lock_acquire (&r->ctx->lock);
+      list_push_back (&r->ctx->done, &r->elem);
+      cond_signal (&r->ctx->done_cond, &r->ctx->lock);
+      lock_release (&r->ctx->lock);
+    }
+}
+
+/* Takes LEN bytes of buffer space for a request of CTX.  Returns
+   false, taking nothing, if that would put the process over
+   AIO_PROCESS_BYTES or all processes over AIO_TOTAL_BYTES. */
+static bool
+reserve (struct aio_context *ctx, unsigned len)
+{
+  bool ok;
+
+  lock_acquire (&work_lock);
+  ok = (ctx->bytes + len <= AIO_PROCESS_BYTES
+        && total_bytes + len <= AIO_TOTAL_BYTES);
+  if (ok)
+    {
+      ctx->bytes += len;
+      total_bytes += len;
+    }
+  lock_release (&work_lock);
+  return ok;
+}
+
+/* Gives back LEN bytes taken by reserve(). */
+static void
+unreserve (struct aio_context *ctx, unsigned len)
+{
+  lock_acquire (&work_lock);
+  ctx->bytes -= len;
+  total_bytes -= len;
+  lock_release (&work_lock);
+}
+
+/* Creates a request for SQE in *RP, copying in its data if it is
+   a write, or sets *RP to a null pointer if SQE is invalid or
+   memory is short.  Returns false, creating nothing, if SQE is
+   valid but there is no buffer space for it now. */
+static bool
+make_request (struct aio_context *ctx, const struct aio_sqe *sqe,
+              struct aio_request **rp)
+{
+  struct process_file *pf;
+  struct aio_request *r;
+
+  *rp = NULL;
+  if ((sqe->opcode != AIO_READ && sqe->opcode != AIO_WRITE)
+      || sqe->len == 0 || sqe->len > AIO_MAX_LEN
+      || (off_t) sqe->offset < 0)
+    return true;
+  if (!reserve (ctx, sqe->len))
+    return false;
+  pf = process_get_file (sqe->fd);
+  r = pf != NULL ? malloc (sizeof *r) : NULL;
+  if (r == NULL)
+    {
+      if (pf != NULL)
+        process_put_file (pf);
+      unreserve (ctx, sqe->len);
+      return true;
+    }
+  r->ctx = ctx;
+  r->opcode = sqe->opcode;
+  r->ubuf = sqe->buf;
+  r->len = sqe->len;
+  r->offset = sqe->offset;
+  r->user_data = sqe->user_data;
+  r->file = pf->isdir ? NULL : file_reopen (pf->file);
+  process_put_file (pf);
+  r->kbuf = malloc (sqe->len);
+  if (r->file == NULL || r->kbuf == NULL)
+    {
+      free_request (r);
+      return true;
+    }
+  if (r->opcode == AIO_WRITE && !copy_from_user (r->kbuf, r->ubuf, r->len))
+    {
+      free_request (r);
+      exit (-1);
+    }
+  *rp = r;
+  return true;
+}
+
+/* Moves requests from CTX's submission queue to the work queue,
+   while the completion queue has room for them and there is
+   buffer space for them.  Requests that cannot be carried out
+   complete at once with result -1.
+   Returns the number of requests taken, or -1 if the queue
+   indexes are corrupt. */
+static int
+submit (struct aio_context *ctx)
+{
+  struct aio_ring *ring = ctx->ring;
+  unsigned sq_tail, cq_head;
+  int submitted = 0;
+
+  if (!copy_from_user (&sq_tail, &ring->sq_tail, sizeof sq_tail))
+    exit (-1);
+  if (sq_tail - ctx->sq_head > AIO_RING_SIZE)
+    return -1;
+
+  while (ctx->sq_head != sq_tail)
+    {
+      struct aio_sqe sqe;
+      struct aio_request *r;
+
+      if (!copy_from_user (&cq_head, &ring->cq_head, sizeof cq_head))
+        exit (-1);
+      if (ctx->pending + (ctx->cq_tail - cq_head) >= AIO_RING_SIZE)
+        break;
+
+      if (!copy_from_user (&sqe, &ring->sq[ctx->sq_head % AIO_RING_SIZE],
+                           sizeof sqe))
+        exit (-1);
+      if (!make_request (ctx, &sqe, &r))
+        break;
+      ctx->sq_head++;
+      submitted++;
+
+      if (r == NULL)
+        {
+          post (ctx, sqe.user_data, -1);
+          continue;
+        }
+      ctx->pending++;
+      lock_acquire (&work_lock);
+      list_push_back (&work_queue, &r->elem);
+      cond_signal (&work_cond, &work_lock);
+      lock_release (&work_lock);
+    }
+
+  if (!copy_to_user (&ring->sq_head, &ctx->sq_head, sizeof ctx->sq_head))
+    exit (-1);
+  return submitted;
+}
+
+/* Posts the completions of CTX's finished requests, copying out
+   the data read. */
+static void
+reap (struct aio_context *ctx)
+{
+  for (;;)
+    {
+      struct aio_request *r;
+      bool ok;
+
+      lock_acquire (&ctx->lock);
+      if (list_empty (&ctx->done))
+        {
+          lock_release (&ctx->lock);
+          break;
+        }
+      r = list_entry (list_pop_front (&ctx->done), struct aio_request, elem);
+      lock_release (&ctx->lock);
+
+      ctx->pending--;
+      if (r->res > 0 && r->opcode == AIO_READ)
+        thread_current ()->rusage.read_bytes += r->res;
+      else if (r->res > 0)
+        thread_current ()->rusage.write_bytes += r->res;
+      ok = (r->opcode != AIO_READ || r->res <= 0
+            || copy_to_user (r->ubuf, r->kbuf, r->res));
+      post (ctx, r->user_data, r->res);
+      free_request (r);
+      if (!ok)
+        exit (-1);
+    }
+}
+
+/* Posts a completion with USER_DATA and RES to CTX's completion
+   queue, which must have room for it. */
+static void
+post (struct aio_context *ctx, unsigned user_data, int res)
+{
+  struct aio_ring *ring = ctx->ring;
+  struct aio_cqe cqe;
+
+  cqe.user_data = user_data;
+  cqe.res = res;
+  if (!copy_to_user (&ring->cq[ctx->cq_tail % AIO_RING_SIZE], &cqe,
+                     sizeof cqe))
+    exit (-1);
+  ctx->cq_tail++;
+  if (!copy_to_user (&ring->cq_tail, &ctx->cq_tail, sizeof ctx->cq_tail))
+    exit (-1);
+}
+
+/* Frees R and its resources. */
+static void
+free_request (struct aio_request *r)
+{
+  unreserve (r->ctx, r->len);
+  file_close (r->file);
+  free (r->kbuf);
+  free (r);
+}
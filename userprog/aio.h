@@ -0,0 +1,7 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+void aio_init (void);
+void aio_exit (void);
+
+#endif /* userprog/aio.h */
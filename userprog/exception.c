@@ -7,6 +7,7 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/syscall.h"
+#include "userprog/usercopy.h"
 #include "vm/page.h"
 
 /* Number of page faults processed. */
@@ -152,21 +153,64 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+  /* A fault in kernel mode comes from a system call touching
+     user memory, so the user stack pointer is the one saved on
+     entry to the system call. */
+  struct thread *t = thread_current();
+  void *esp = user ? f->esp : t->esp;
+  unsigned page_reads = t->page_reads;
   bool load = false;
+  // The process's other threads may fault on the same page or
+  // change its mappings meanwhile.
+  lock_acquire(&t->process->vm_lock);
   if (not_present && fault_addr > USER_VADDR_BOTTOM &&
       is_user_vaddr(fault_addr))
     {
       struct sup_page_entry *spte = get_spte(fault_addr);
-      if (spte)
+      if (spte && spte->is_loaded)
+	{
+	  // Another thread of the process brought it in first.
+	  load = true;
+	}
+      else if (spte)
 	{
 	  load = load_page(spte);
 	  spte->pinned = false;
 	}
-      else if (fault_addr >= f->esp - STACK_HEURISTIC)
+      else if (fault_addr >= esp - STACK_HEURISTIC)
 	{
 	  load = grow_stack(fault_addr);
 	}
     }
+  else if (!not_present && write && fault_addr > USER_VADDR_BOTTOM &&
+	   is_user_vaddr(fault_addr))
+    {
+      // A write to a present page that is mapped read-only but
+      // writable in the spte hits a page shared copy-on-write.
+      struct sup_page_entry *spte = get_spte(fault_addr);
+      if (spte && spte->writable)
+	{
+	  load = frame_cow_break(spte);
+	  spte->pinned = false;
+	}
+    }
+  lock_release(&t->process->vm_lock);
+  if (load)
+    {
+      // A fault that had to read the page in is a major one.
+      if (t->page_reads != page_reads)
+	{
+	  t->rusage.majflt++;
+	}
+      else
+	{
+	  t->rusage.minflt++;
+	}
+    }
+  if (!load && !user && usercopy_fixup(f))
+    {
+      return;
+    }
   if (!load)
     {
       printf ("Page fault at %p: %s error %s page in %s context.\n",
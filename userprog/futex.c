@@ -0,0 +1,165 @@
+#include "userprog/futex.h"
+#include <list.h>
+#include <stdint.h>
+#include <user/syscall.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/syscall.h"
+#include "userprog/usercopy.h"
+
+/* Futexes.
+
+   A futex is any int in a process's memory.  futex_wait() puts
+   the calling thread to sleep if the int still holds the value
+   the caller last saw, and futex_wake() wakes threads of the same
+   process sleeping on it.  The kernel keeps nothing for a futex
+   nobody sleeps on: the sleepers are in a hash table keyed by
+   process and address.  The value is read before futex_lock is
+   taken, since reading it may fault and the lock is global.  To
+   keep a wakeup from falling between the read and the enqueue,
+   futex_wake() counts its calls on each bucket under futex_lock,
+   and futex_wait() reads the count before the value and goes to
+   sleep only if it has not changed since.  User code does the
+   fast path with atomic instructions and calls in only to sleep
+   or to wake a sleeper. */
+
+/* Number of buckets in the table of sleepers. */
+#define FUTEX_BUCKETS 64
+
+/* A thread sleeping in futex_wait(), on its kernel stack. */
+struct futex_waiter
+  {
+    struct list_elem elem;      /* In a futex_table bucket. */
+    struct thread *process;     /* Owner of the process. */
+    const int *uaddr;           /* User address of the futex. */
+    struct semaphore sema;      /* Upped to wake the thread. */
+  };
+
+/* Sleeping threads, hashed by user address, and the number of
+   futex_wake() calls on each bucket so far. */
+static struct list futex_table[FUTEX_BUCKETS];
+static unsigned futex_wakes[FUTEX_BUCKETS];
+static struct lock futex_lock;
+
+/* Initializes the table of sleepers. */
+void
+futex_init (void)
+{
+  int i;
+
+  for (i = 0; i < FUTEX_BUCKETS; i++)
+    list_init (&futex_table[i]);
+  lock_init (&futex_lock);
+}
+
+/* Returns the index of the bucket for UADDR.  The low bits are
+   dropped since futexes are usually aligned ints. */
+static int
+futex_hash (const int *uaddr)
+{
+  return ((uintptr_t) uaddr >> 2) % FUTEX_BUCKETS;
+}
+
+/* If the int at UADDR equals VAL, sleeps until futex_wake() is
+   called on UADDR by a thread of the same process, or until the
+   process exits, and returns 0.  Otherwise returns -1 at once. */
+int
+futex_wait (int *uaddr, int val)
+{
+  struct thread *p = process_current ();
+  int h = futex_hash (uaddr);
+  struct futex_waiter w;
+  unsigned wakes;
+  int cur;
+
+  do
+    {
+      lock_acquire (&futex_lock);
+      wakes = futex_wakes[h];
+      lock_release (&futex_lock);
+
+      if (!copy_from_user (&cur, uaddr, sizeof cur))
+        exit (ERROR);
+      if (cur != val)
+        return ERROR;
+
+      /* A wake on the bucket since the read may have followed a
+         change to the value, so read it again. */
+      lock_acquire (&futex_lock);
+      if (futex_wakes[h] == wakes)
+        break;
+      lock_release (&futex_lock);
+    }
+  while (true);
+
+  if (p->exiting)
+    {
+      lock_release (&futex_lock);
+      return ERROR;
+    }
+  w.process = p;
+  w.uaddr = uaddr;
+  sema_init (&w.sema, 0);
+  list_push_back (&futex_table[h], &w.elem);
+  lock_release (&futex_lock);
+
+  sema_down (&w.sema);
+  return 0;
+}
+
+/* Wakes up to CNT threads of the current process sleeping on
+   UADDR, longest sleeping first, and returns how many woke. */
+int
+futex_wake (int *uaddr, int cnt)
+{
+  struct thread *p = process_current ();
+  int h = futex_hash (uaddr);
+  struct list *bucket = &futex_table[h];
+  struct list_elem *e;
+  int woken = 0;
+
+  lock_acquire (&futex_lock);
+  futex_wakes[h]++;
+  for (e = list_begin (bucket); e != list_end (bucket) && woken < cnt; )
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+      e = list_next (e);
+      if (w->process == p && w->uaddr == uaddr)
+        {
+          list_remove (&w->elem);
+          sema_up (&w->sema);
+          woken++;
+        }
+    }
+  lock_release (&futex_lock);
+  return woken;
+}
+
+/* Wakes every thread of PROCESS sleeping on any futex, because
+   the process is exiting.  The caller must have set
+   PROCESS->exiting first, so that none goes to sleep afterward. */
+void
+futex_wake_all (struct thread *process)
+{
+  int i;
+
+  lock_acquire (&futex_lock);
+  for (i = 0; i < FUTEX_BUCKETS; i++)
+    {
+      struct list *bucket = &futex_table[i];
+      struct list_elem *e;
+
+      for (e = list_begin (bucket); e != list_end (bucket); )
+        {
+          struct futex_waiter *w = list_entry (e, struct futex_waiter,
+                                               elem);
+          e = list_next (e);
+          if (w->process == process)
+            {
+              list_remove (&w->elem);
+              sema_up (&w->sema);
+            }
+        }
+    }
+  lock_release (&futex_lock);
+}
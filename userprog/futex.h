@@ -0,0 +1,9 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+struct thread;
+
+void futex_init (void);
+void futex_wake_all (struct thread *process);
+
+#endif /* userprog/futex.h */
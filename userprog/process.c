@@ -5,12 +5,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/aio.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
+#include "userprog/usercopy.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
@@ -23,8 +27,38 @@
 #include "vm/page.h"
 
 static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp,
-		  char** save_ptr);
+static thread_func start_fork NO_RETURN;
+static thread_func start_uthread NO_RETURN;
+static bool load (char *cmd_line, void (**eip) (void), void **esp);
+static void uthread_exit (void);
+static void process_set_exiting (struct thread *);
+
+/* A thread that thread_spawn() made in a process, as the other
+   threads of the process see it.  Records are kept in the list of
+   the process's main thread until joined or until the process
+   exits, and are guarded by uthread_lock. */
+struct uthread
+  {
+    struct list_elem elem;      /* In the process's uthreads. */
+    tid_t tid;                  /* Thread identifier. */
+    int slot;                   /* Stack slot. */
+    bool joined;                /* Claimed by a thread_join(). */
+    bool ended;                 /* Called thread_end(). */
+    bool exited;                /* Done with the process. */
+    int status;                 /* Given to thread_end(). */
+  };
+
+/* Guards every process's uthreads, uthread_cnt, stack_slots,
+   and exiting, and the records. */
+static struct lock uthread_lock;
+
+/* Passed from process_execute() to start_process(), in a page
+   of its own that the command line fills out. */
+struct exec_info
+  {
+    struct child_process *cp;           /* Parent's record of the child. */
+    char cmd_line[];                    /* Copy of the command line. */
+  };
 
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
@@ -33,45 +67,53 @@ static bool load (const char *cmdline, void (**eip) (void), void **esp,
 tid_t
 process_execute (const char *file_name) 
 {
-  char *fn_copy, *parsed_fn;
+  struct exec_info *info;
+  struct child_process *cp;
+  char name[16];
+  size_t len;
   tid_t tid;
 
   /* Make a copy of FILE_NAME.
      Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
+  info = palloc_get_page (0);
+  if (info == NULL)
     return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
-
-  // Get parsed file name
-  parsed_fn = palloc_get_page (0);
-  if (parsed_fn == NULL)
-    return TID_ERROR;
-  strlcpy (parsed_fn, file_name, PGSIZE);
+  cp = info->cp = new_child_process ();
+  if (cp == NULL)
+    {
+      palloc_free_page (info);
+      return TID_ERROR;
+    }
+  strlcpy (info->cmd_line, file_name, PGSIZE - sizeof *info);
 
-  char *save_ptr;
-  parsed_fn = strtok_r((char *) parsed_fn, " ", &save_ptr);
+  /* Name the thread after the program, the first word. */
+  file_name += strspn (file_name, " ");
+  len = strcspn (file_name, " ");
+  strlcpy (name, file_name, len < sizeof name ? len + 1 : sizeof name);
 
   /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (parsed_fn, PRI_DEFAULT, start_process, fn_copy);
-  palloc_free_page(parsed_fn);
+  tid = thread_create (name, PRI_DEFAULT, start_process, info);
   if (tid == TID_ERROR)
-    palloc_free_page (fn_copy);
+    {
+      free (cp);
+      palloc_free_page (info);
+    }
+  else
+    add_child_process (cp, tid);
   return tid;
 }
 
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *info_)
 {
-  char *file_name = file_name_;
+  struct exec_info *info = info_;
+  char *file_name = info->cmd_line;
   struct intr_frame if_;
   bool success;
 
-  // Get actual file name (first parsed token)
-  char *save_ptr;
-  file_name = strtok_r(file_name, " ", &save_ptr);
+  thread_current ()->cp = info->cp;
 
   // Initialize page table
   page_table_init(&thread_current()->spt);
@@ -81,7 +123,7 @@ start_process (void *file_name_)
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp, &save_ptr);
+  success = load (file_name, &if_.eip, &if_.esp);
   if (success)
     {
       thread_current()->cp->load = LOAD_SUCCESS;
@@ -93,7 +135,7 @@ start_process (void *file_name_)
   sema_up(&thread_current()->cp->load_sema);
 
   /* If load failed, quit. */
-  palloc_free_page (file_name);
+  palloc_free_page (info);
   if (!success) 
     thread_exit ();
 
@@ -107,6 +149,449 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+/* Passed from process_fork() to start_fork(). */
+struct fork_info
+  {
+    struct thread *parent;              /* Process calling fork(). */
+    struct intr_frame if_;              /* Its registers at the call. */
+    struct semaphore done;              /* Upped when the copy is done. */
+    bool success;                       /* Whether the copy succeeded. */
+    struct child_process *cp;           /* Parent's record of the child. */
+  };
+
+/* Starts a copy of the current process, which is in the system
+   call whose interrupt frame is F, and waits until the copy has
+   its own address space and descriptors.  Returns the new
+   process's thread id, or TID_ERROR on failure. */
+tid_t
+process_fork (struct intr_frame *f)
+{
+  struct fork_info info;
+  tid_t tid;
+
+  info.parent = process_current ();
+  info.if_ = *f;
+  sema_init (&info.done, 0);
+  info.cp = new_child_process ();
+  if (info.cp == NULL)
+    return TID_ERROR;
+  tid = thread_create (info.parent->name, PRI_DEFAULT, start_fork, &info);
+  if (tid == TID_ERROR)
+    {
+      free (info.cp);
+      return TID_ERROR;
+    }
+  sema_down (&info.done);
+  if (!info.success)
+    {
+      /* The child exits without reporting to the record. */
+      free (info.cp);
+      return TID_ERROR;
+    }
+  add_child_process (info.cp, tid);
+  return tid;
+}
+
+/* Gives the current thread copies of PARENT's executable and
+   open files and directories.  The copies start at the same
+   positions but move independently. */
+static bool
+fork_files (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  int fd;
+
+  t->executable = file_reopen (parent->executable);
+  if (t->executable == NULL)
+    return false;
+  file_deny_write (t->executable);
+
+  lock_acquire (&parent->files_lock);
+  t->files = calloc (parent->file_cnt, sizeof *t->files);
+  if (parent->file_cnt > 0 && t->files == NULL)
+    {
+      lock_release (&parent->files_lock);
+      return false;
+    }
+  t->file_cnt = parent->file_cnt;
+  t->fd = parent->fd;
+  for (fd = MIN_FD; fd < parent->file_cnt; fd++)
+    {
+      struct process_file *pf = parent->files[fd];
+      struct process_file *copy;
+
+      if (pf == NULL)
+        continue;
+      copy = calloc (1, sizeof *copy);
+      if (copy == NULL)
+        break;
+      t->files[fd] = copy;
+      copy->fd = fd;
+      copy->isdir = pf->isdir;
+      copy->ref_cnt = 1;
+      if (pf->isdir)
+        {
+          copy->dir = dir_reopen (pf->dir);
+          if (copy->dir == NULL)
+            break;
+        }
+      else
+        {
+          copy->file = file_reopen (pf->file);
+          if (copy->file == NULL)
+            break;
+          file_seek (copy->file, file_tell (pf->file));
+        }
+    }
+  lock_release (&parent->files_lock);
+  return fd >= parent->file_cnt;
+}
+
+/* A thread function that makes the new thread a copy of the
+   process that called fork() and returns to user mode in it,
+   with 0 as the result of fork(). */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+
+  page_table_init (&t->spt);
+  t->pagedir = pagedir_create ();
+  if (t->pagedir != NULL)
+    {
+      process_activate ();
+      success = fork_files (info->parent);
+      if (success)
+        {
+          /* The stacks of the parent's other threads are copied
+             too, with nothing to run on them, so their slots stay
+             taken. */
+          lock_acquire (&info->parent->vm_lock);
+          t->heap_start = info->parent->heap_start;
+          t->brk = info->parent->brk;
+          t->stack_slots = info->parent->stack_slots;
+          success = page_table_copy (info->parent);
+          lock_release (&info->parent->vm_lock);
+        }
+    }
+  if (success)
+    t->cp = info->cp;
+  info->success = success;
+  sema_up (&info->done);
+  if (!success)
+    thread_exit ();
+
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Returns the top of the stack in slot SLOT. */
+static uint8_t *
+stack_top (int slot)
+{
+  return THREAD_STACKS_BOTTOM + (slot + 1) * THREAD_STACK_SIZE;
+}
+
+/* Adds the pages of the stack in slot SLOT to the current
+   process's page table, except the lowest, which stays unmapped
+   to catch overflow.  The caller must hold vm_lock. */
+static bool
+stack_map (int slot)
+{
+  uint8_t *bottom = stack_top (slot) - THREAD_STACK_SIZE;
+  uint8_t *page;
+
+  for (page = stack_top (slot) - PGSIZE; page > bottom; page -= PGSIZE)
+    if (!add_zero_to_page_table (page))
+      {
+        /* Take back the pages added so far. */
+        while ((page += PGSIZE) < stack_top (slot))
+          page_remove (get_spte (page));
+        return false;
+      }
+  return true;
+}
+
+/* Removes the pages that stack_map() added for slot SLOT.  The
+   caller must hold vm_lock. */
+static void
+stack_unmap (int slot)
+{
+  uint8_t *bottom = stack_top (slot) - THREAD_STACK_SIZE;
+  uint8_t *page;
+
+  for (page = stack_top (slot) - PGSIZE; page > bottom; page -= PGSIZE)
+    {
+      struct sup_page_entry *spte = get_spte (page);
+      if (spte != NULL)
+        page_remove (spte);
+    }
+}
+
+/* Passed from process_spawn() to start_uthread(). */
+struct spawn_info
+  {
+    struct thread *process;             /* Process to run in. */
+    struct uthread *uthread;            /* Record of the new thread. */
+    void (*start) (void);               /* User entry point. */
+    void *func, *aux;                   /* Its arguments. */
+    struct semaphore done;              /* Upped when set up. */
+    bool success;                       /* Whether that succeeded. */
+  };
+
+/* Starts a thread in the current process, sharing its memory and
+   descriptors, that calls START (FUNC, AUX) on a stack of its
+   own.  START must not return.  Returns the new thread's id, or
+   TID_ERROR if memory or stack slots are short or the process is
+   exiting. */
+tid_t
+process_spawn (void (*start) (void), void *func, void *aux)
+{
+  struct thread *p = process_current ();
+  struct spawn_info info;
+  struct uthread *u;
+  bool success;
+  tid_t tid;
+  int slot;
+
+  u = malloc (sizeof *u);
+  if (u == NULL)
+    return TID_ERROR;
+
+  /* Claim a stack slot. */
+  lock_acquire (&uthread_lock);
+  for (slot = 0; slot < THREAD_STACK_SLOTS; slot++)
+    if ((p->stack_slots & (1u << slot)) == 0)
+      break;
+  success = slot < THREAD_STACK_SLOTS && !p->exiting;
+  if (success)
+    p->stack_slots |= 1u << slot;
+  lock_release (&uthread_lock);
+  if (!success)
+    {
+      free (u);
+      return TID_ERROR;
+    }
+
+  lock_acquire (&p->vm_lock);
+  success = stack_map (slot);
+  lock_release (&p->vm_lock);
+
+  u->tid = TID_ERROR;
+  u->slot = slot;
+  u->joined = u->ended = u->exited = false;
+  u->status = ERROR;
+  lock_acquire (&uthread_lock);
+  if (success)
+    {
+      list_push_back (&p->uthreads, &u->elem);
+      p->uthread_cnt++;
+    }
+  else
+    p->stack_slots &= ~(1u << slot);
+  lock_release (&uthread_lock);
+  if (!success)
+    {
+      free (u);
+      return TID_ERROR;
+    }
+
+  info.process = p;
+  info.uthread = u;
+  info.start = start;
+  info.func = func;
+  info.aux = aux;
+  sema_init (&info.done, 0);
+  tid = thread_create (p->name, PRI_DEFAULT, start_uthread, &info);
+  if (tid == TID_ERROR)
+    {
+      lock_acquire (&p->vm_lock);
+      stack_unmap (slot);
+      lock_release (&p->vm_lock);
+      lock_acquire (&uthread_lock);
+      list_remove (&u->elem);
+      p->uthread_cnt--;
+      p->stack_slots &= ~(1u << slot);
+      lock_release (&uthread_lock);
+      free (u);
+      return TID_ERROR;
+    }
+
+  lock_acquire (&uthread_lock);
+  u->tid = tid;
+  lock_release (&uthread_lock);
+  sema_down (&info.done);
+  if (!info.success)
+    {
+      process_join (tid);
+      return TID_ERROR;
+    }
+  return tid;
+}
+
+/* A thread function that joins the new thread to the process
+   that called thread_spawn() and enters user mode on its own
+   stack. */
+static void
+start_uthread (void *info_)
+{
+  struct spawn_info *info = info_;
+  struct thread *t = thread_current ();
+  struct intr_frame if_;
+  uint32_t frame[3];
+
+  t->process = info->process;
+  t->uthread = info->uthread;
+  t->pagedir = info->process->pagedir;
+  process_activate ();
+
+  /* Call START (FUNC, AUX) with a null return address. */
+  frame[0] = 0;
+  frame[1] = (uint32_t) info->func;
+  frame[2] = (uint32_t) info->aux;
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = info->start;
+  if_.esp = stack_top (t->uthread->slot) - sizeof frame;
+  info->success = copy_to_user (if_.esp, frame, sizeof frame);
+  if (!info->success)
+    t->uthread->ended = true;
+  sema_up (&info->done);
+  if (!t->uthread->ended)
+    asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  thread_exit ();
+}
+
+/* Waits for thread TID of the current process, made by
+   thread_spawn(), to end, and returns the status it gave
+   thread_end().  Returns -1 at once if TID is not such a thread
+   or another thread is joining it, and -1 if it died some other
+   way or the process began to exit meanwhile. */
+int
+process_join (tid_t tid)
+{
+  struct thread *p = process_current ();
+  struct uthread *u = NULL;
+  struct list_elem *e;
+  int status = ERROR;
+
+  lock_acquire (&uthread_lock);
+  for (e = list_begin (&p->uthreads); e != list_end (&p->uthreads);
+       e = list_next (e))
+    {
+      struct uthread *cand = list_entry (e, struct uthread, elem);
+      if (cand->tid == tid && !cand->joined && tid != thread_tid ())
+        {
+          u = cand;
+          break;
+        }
+    }
+  if (u != NULL)
+    {
+      u->joined = true;
+      while (!u->exited && !p->exiting)
+        cond_wait (&p->uthread_changed, &uthread_lock);
+      if (u->exited)
+        {
+          if (u->ended)
+            status = u->status;
+          list_remove (&u->elem);
+          free (u);
+        }
+      else
+        u->joined = false;
+    }
+  lock_release (&uthread_lock);
+  return status;
+}
+
+/* Ends the current thread, which thread_spawn() made, so that
+   thread_join() returns STATUS.  The rest of the process goes
+   on. */
+void
+process_thread_end (int status)
+{
+  struct uthread *u = thread_current ()->uthread;
+
+  ASSERT (u != NULL);
+  lock_acquire (&uthread_lock);
+  u->status = status;
+  u->ended = true;
+  lock_release (&uthread_lock);
+  thread_exit ();
+}
+
+/* Marks process P as exiting, so that each of its threads exits
+   instead of going back to user mode, and wakes the ones asleep
+   in thread_join() or futex_wait() so that they can. */
+static void
+process_set_exiting (struct thread *p)
+{
+  lock_acquire (&uthread_lock);
+  p->exiting = true;
+  cond_broadcast (&p->uthread_changed, &uthread_lock);
+  lock_release (&uthread_lock);
+  futex_wake_all (p);
+}
+
+/* Frees what the current thread, which thread_spawn() made, has
+   of its own, and hands its resource usage to the process.
+   Unless it called thread_end(), the whole process exits. */
+static void
+uthread_exit (void)
+{
+  struct thread *cur = thread_current ();
+  struct thread *p = cur->process;
+  struct uthread *u = cur->uthread;
+  enum intr_level old_level;
+
+  if (!u->ended)
+    process_set_exiting (p);
+  remove_child_processes ();
+  dir_close (cur->cudir);
+  cur->cudir = NULL;
+
+  lock_acquire (&p->vm_lock);
+  stack_unmap (u->slot);
+  lock_release (&p->vm_lock);
+  cur->pagedir = NULL;
+  pagedir_activate (NULL);
+
+  old_level = intr_disable ();
+  rusage_add (&p->rusage, &cur->rusage);
+  intr_set_level (old_level);
+
+  lock_acquire (&uthread_lock);
+  p->stack_slots &= ~(1u << u->slot);
+  p->uthread_cnt--;
+  u->exited = true;
+  cond_broadcast (&p->uthread_changed, &uthread_lock);
+  lock_release (&uthread_lock);
+}
+
+/* Adds the usage in SRC to DST.  The peak resident set is the
+   larger of the two, not their sum. */
+void
+rusage_add (struct rusage *dst, const struct rusage *src)
+{
+  dst->utime += src->utime;
+  dst->stime += src->stime;
+  dst->minflt += src->minflt;
+  dst->majflt += src->majflt;
+  dst->swapins += src->swapins;
+  dst->swapouts += src->swapouts;
+  dst->read_bytes += src->read_bytes;
+  dst->write_bytes += src->write_bytes;
+  if (src->maxrss > dst->maxrss)
+    dst->maxrss = src->maxrss;
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -119,22 +604,11 @@ start_process (void *file_name_)
 int
 process_wait (tid_t child_tid UNUSED) 
 {
-  struct child_process* cp = get_child_process(child_tid);
-  if (!cp)
+  int status;
+  if (reap_child_process(child_tid, false, &status) == ERROR)
     {
       return ERROR;
     }
-  if (cp->wait)
-    {
-      return ERROR;
-    }
-  cp->wait = true;
-  if (!cp->exit)
-    {
-      sema_down(&cp->exit_sema);
-    }
-  int status = cp->status;
-  remove_child_process(cp);
   return status;
 }
 
@@ -145,23 +619,51 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
+  aio_exit();
+
+  if (cur->uthread)
+    {
+      uthread_exit ();
+      return;
+    }
+
+  // Stop the process's other threads and wait until they are gone
+  if (cur->pagedir)
+    {
+      process_set_exiting (cur);
+      lock_acquire (&uthread_lock);
+      while (cur->uthread_cnt > 0)
+	{
+	  cond_wait (&cur->uthread_changed, &uthread_lock);
+	}
+      while (!list_empty (&cur->uthreads))
+	{
+	  free (list_entry (list_pop_front (&cur->uthreads),
+			    struct uthread, elem));
+	}
+      lock_release (&uthread_lock);
+    }
+  syscall_exit_stats();
+
   // Close all files opened by process
-  lock_acquire(&filesys_lock);
   process_close_file(CLOSE_ALL);
   if (cur->executable)
     {
       file_close(cur->executable);
     }
-  lock_release(&filesys_lock);
 
-  // Free child list
+  // Free children table
   remove_child_processes();
 
-  // Set exit value to true in case killed by the kernel
-  if (thread_alive(cur->parent) && cur->cp && cur->executable)
+  // Report the exit to the parent, even if killed by the kernel
+  if (cur->executable)
     {
-      cur->cp->exit = true;
-      sema_up(&cur->cp->exit_sema);
+      struct rusage usage;
+      enum intr_level old_level = intr_disable ();
+      usage = cur->rusage;
+      intr_set_level (old_level);
+      rusage_add (&usage, &cur->child_rusage);
+      child_process_exit (&usage);
     }
 
   process_remove_mmap(CLOSE_ALL);
@@ -264,51 +766,187 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-// Used for setup_stack
-#define WORD_SIZE 4
-#define DEFAULT_ARGV 2
-
-static bool setup_stack (void **esp, const char* file_name,
-			 char** save_ptr);
+static int split_args (char *cmd_line, size_t *size);
+static bool setup_stack (void **esp, const char *args, int argc,
+                         size_t size);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
-   Stores the executable's entry point into *EIP
-   and its initial stack pointer into *ESP.
-   Returns true if successful, false otherwise. */
-bool
-load (const char *file_name, void (**eip) (void), void **esp,
-      char **save_ptr) 
+/* A loadable segment of an executable, as validated by load(). */
+struct exec_segment
+  {
+    off_t file_page;            /* Offset of its first page in the file. */
+    uint32_t mem_page;          /* User address of its first page. */
+    uint32_t read_bytes;        /* Bytes to read from the file. */
+    uint32_t zero_bytes;        /* Bytes to zero after them. */
+    bool writable;              /* Whether its pages are writable. */
+  };
+
+/* What load() needs from an executable's ELF headers. */
+struct exec_image
+  {
+    struct list_elem elem;      /* Element in exec_cache. */
+    struct inode *inode;        /* Executable, kept open while cached. */
+    unsigned write_cnt;         /* inode_write_cnt() when parsed. */
+    void (*entry) (void);       /* Entry point. */
+    int seg_cnt;                /* Number of segments. */
+    struct exec_segment segs[]; /* Loadable segments. */
+  };
+
+/* Parsed executables, most recently used first, so that loading
+   a program that ran recently needs no ELF header I/O.  Each
+   image holds its executable's inode open.  An image is dropped
+   once its inode has been written to, which running programs
+   prevent, so in practice only when a file is rewritten between
+   runs.  It is also dropped as soon as its executable is removed
+   and when the file system shuts down, so that the cache never
+   keeps a removed file's sectors allocated. */
+#define EXEC_CACHE_SIZE 8
+static struct list exec_cache;
+static struct lock exec_cache_lock;
+
+/* Initializes the cache of parsed executables, and the lock on
+   the records of threads within processes. */
+void
+process_init (void)
 {
-  struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
-  struct file *file = NULL;
-  off_t file_ofs;
-  bool success = false;
-  int i;
+  list_init (&exec_cache);
+  lock_init (&exec_cache_lock);
+  lock_init (&uthread_lock);
+}
 
-  /* Allocate and activate page directory. */
-  t->pagedir = pagedir_create ();
-  if (t->pagedir == NULL) 
-    goto done;
-  process_activate ();
+/* Returns the size of an image with SEG_CNT segments. */
+static size_t
+image_size (int seg_cnt)
+{
+  return sizeof (struct exec_image) + seg_cnt * sizeof (struct exec_segment);
+}
 
-  /* Open executable file. */
-  lock_acquire(&filesys_lock);
-  file = filesys_open (file_name);
-  if (file == NULL) 
+/* Removes IMAGE from the cache and frees it.  The caller must
+   hold exec_cache_lock. */
+static void
+image_drop (struct exec_image *image)
+{
+  list_remove (&image->elem);
+  inode_close (image->inode);
+  free (image);
+}
+
+/* Returns a copy of the cached image of INODE, which the caller
+   must free, or a null pointer if there is none.  Drops stale
+   images on the way. */
+static struct exec_image *
+exec_cache_lookup (struct inode *inode)
+{
+  struct exec_image *copy = NULL;
+  struct list_elem *e, *next;
+
+  lock_acquire (&exec_cache_lock);
+  for (e = list_begin (&exec_cache); e != list_end (&exec_cache); e = next)
     {
-      printf ("load: %s: open failed\n", file_name);
-      goto done; 
+      struct exec_image *image = list_entry (e, struct exec_image, elem);
+
+      next = list_next (e);
+      if (inode_is_removed (image->inode)
+          || inode_write_cnt (image->inode) != image->write_cnt)
+        image_drop (image);
+      else if (image->inode == inode)
+        {
+          copy = malloc (image_size (image->seg_cnt));
+          if (copy != NULL)
+            memcpy (copy, image, image_size (image->seg_cnt));
+          list_remove (e);
+          list_push_front (&exec_cache, e);
+        }
     }
-  file_deny_write(file);
-  t->executable = file;
+  lock_release (&exec_cache_lock);
+  return copy;
+}
+
+/* Drops the cached images of executables that have been removed,
+   or every image if ALL is true. */
+static void
+exec_cache_drop (bool all)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&exec_cache_lock);
+  for (e = list_begin (&exec_cache); e != list_end (&exec_cache); e = next)
+    {
+      struct exec_image *image = list_entry (e, struct exec_image, elem);
+
+      next = list_next (e);
+      if (all || inode_is_removed (image->inode))
+        image_drop (image);
+    }
+  lock_release (&exec_cache_lock);
+}
+
+/* Drops the cached images of executables that have been removed,
+   so that their sectors are freed once no process is running
+   them.  Called after a file is removed. */
+void
+exec_cache_drop_removed (void)
+{
+  exec_cache_drop (false);
+}
+
+/* Drops every cached image, closing the inodes they hold open.
+   Called when the file system shuts down, before the free map is
+   written out. */
+void
+exec_cache_flush (void)
+{
+  exec_cache_drop (true);
+}
+
+/* Adds a copy of IMAGE, parsed from INODE, to the cache, and
+   drops the least recently used image if the cache is full. */
+static void
+exec_cache_insert (struct exec_image *image, struct inode *inode)
+{
+  struct exec_image *copy;
+  struct list_elem *e;
+
+  lock_acquire (&exec_cache_lock);
+  for (e = list_begin (&exec_cache); e != list_end (&exec_cache);
+       e = list_next (e))
+    if (list_entry (e, struct exec_image, elem)->inode == inode)
+      {
+        /* Another process parsed it first. */
+        lock_release (&exec_cache_lock);
+        return;
+      }
+
+  copy = malloc (image_size (image->seg_cnt));
+  if (copy != NULL)
+    {
+      memcpy (copy, image, image_size (image->seg_cnt));
+      copy->inode = inode_reopen (inode);
+      list_push_front (&exec_cache, &copy->elem);
+      if (list_size (&exec_cache) > EXEC_CACHE_SIZE)
+        image_drop (list_entry (list_back (&exec_cache),
+                                struct exec_image, elem));
+    }
+  lock_release (&exec_cache_lock);
+}
+
+/* Reads and validates the ELF headers of FILE, the executable
+   named FILE_NAME.  Returns what load() needs from them, which
+   the caller must free, or a null pointer on failure. */
+static struct exec_image *
+parse_executable (struct file *file, const char *file_name)
+{
+  struct Elf32_Ehdr ehdr;
+  struct Elf32_Phdr *phdrs = NULL;
+  struct exec_image *image = NULL;
+  size_t phdrs_size;
+  int i;
 
   /* Read and verify executable header. */
-  if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
+  if (file_read_at (file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
       || ehdr.e_type != 2
       || ehdr.e_machine != 3
@@ -317,23 +955,34 @@ load (const char *file_name, void (**eip) (void), void **esp,
       || ehdr.e_phnum > 1024) 
     {
       printf ("load: %s: error loading executable\n", file_name);
-      goto done; 
+      return NULL;
     }
 
-  /* Read program headers. */
-  file_ofs = ehdr.e_phoff;
-  for (i = 0; i < ehdr.e_phnum; i++) 
+  image = malloc (image_size (ehdr.e_phnum));
+  if (image == NULL)
+    return NULL;
+  image->write_cnt = inode_write_cnt (file_get_inode (file));
+  image->entry = (void (*) (void)) ehdr.e_entry;
+  image->seg_cnt = 0;
+
+  /* Read all the program headers at once. */
+  phdrs_size = ehdr.e_phnum * sizeof *phdrs;
+  if (phdrs_size > 0)
     {
-      struct Elf32_Phdr phdr;
+      if (ehdr.e_phoff > (Elf32_Off) file_length (file))
+        goto fail;
+      phdrs = malloc (phdrs_size);
+      if (phdrs == NULL
+          || (size_t) file_read_at (file, phdrs, phdrs_size,
+                                    ehdr.e_phoff) != phdrs_size)
+        goto fail;
+    }
 
-      if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
-      file_seek (file, file_ofs);
+  for (i = 0; i < ehdr.e_phnum; i++) 
+    {
+      struct Elf32_Phdr *phdr = &phdrs[i];
 
-      if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
-      file_ofs += sizeof phdr;
-      switch (phdr.p_type) 
+      switch (phdr->p_type) 
         {
         case PT_NULL:
         case PT_NOTE:
@@ -345,55 +994,146 @@ load (const char *file_name, void (**eip) (void), void **esp,
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-          goto done;
+          goto fail;
         case PT_LOAD:
-          if (validate_segment (&phdr, file)) 
+          if (validate_segment (phdr, file)) 
             {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
-              uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
-              if (phdr.p_filesz > 0)
+              struct exec_segment *seg = &image->segs[image->seg_cnt++];
+              uint32_t page_offset = phdr->p_vaddr & PGMASK;
+
+              seg->writable = (phdr->p_flags & PF_W) != 0;
+              seg->file_page = phdr->p_offset & ~PGMASK;
+              seg->mem_page = phdr->p_vaddr & ~PGMASK;
+              if (phdr->p_filesz > 0)
                 {
                   /* Normal segment.
                      Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
+                  seg->read_bytes = page_offset + phdr->p_filesz;
+                  seg->zero_bytes = (ROUND_UP (page_offset + phdr->p_memsz,
+                                               PGSIZE)
+                                     - seg->read_bytes);
                 }
               else 
                 {
                   /* Entirely zero.
                      Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
+                  seg->read_bytes = 0;
+                  seg->zero_bytes = ROUND_UP (page_offset + phdr->p_memsz,
+                                              PGSIZE);
                 }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
             }
           else
-            goto done;
+            goto fail;
           break;
         }
     }
+  free (phdrs);
+  return image;
+
+ fail:
+  free (phdrs);
+  free (image);
+  return NULL;
+}
+
+/* Executables of at most PREFAULT_SMALL_PAGES pages are loaded
+   in full by load(); larger ones get the first PREFAULT_PAGES
+   pages of each segment, and the rest on demand. */
+#define PREFAULT_SMALL_PAGES 16
+#define PREFAULT_PAGES 4
+
+/* Loads the ELF executable named by the first word of CMD_LINE,
+   a page that load() rewrites, into the current thread, with the
+   words of CMD_LINE as its arguments.
+   Stores the executable's entry point into *EIP
+   and its initial stack pointer into *ESP.
+   Returns true if successful, false otherwise. */
+bool
+load (char *cmd_line, void (**eip) (void), void **esp) 
+{
+  struct thread *t = thread_current ();
+  struct exec_image *image = NULL;
+  struct file *file = NULL;
+  const char *file_name = cmd_line;
+  size_t page_cnt, args_size;
+  bool success = false;
+  int i, argc;
+
+  argc = split_args (cmd_line, &args_size);
+  if (argc == 0)
+    goto done;
+
+  /* Allocate and activate page directory. */
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL) 
+    goto done;
+  process_activate ();
+
+  /* Open executable file. */
+  file = filesys_open (file_name);
+  if (file == NULL) 
+    {
+      printf ("load: %s: open failed\n", file_name);
+      goto done; 
+    }
+  file_deny_write(file);
+  t->executable = file;
+
+  /* Parse the ELF headers, unless a recent load already did. */
+  image = exec_cache_lookup (file_get_inode (file));
+  if (image == NULL)
+    {
+      image = parse_executable (file, file_name);
+      if (image == NULL)
+        goto done;
+      exec_cache_insert (image, file_get_inode (file));
+    }
+
+  page_cnt = 0;
+  t->heap_start = NULL;
+  for (i = 0; i < image->seg_cnt; i++)
+    {
+      struct exec_segment *seg = &image->segs[i];
+      uint8_t *end;
+      if (!load_segment (file, seg->file_page, (void *) seg->mem_page,
+                         seg->read_bytes, seg->zero_bytes, seg->writable))
+        goto done;
+      page_cnt += (seg->read_bytes + seg->zero_bytes) / PGSIZE;
+      end = (uint8_t *) seg->mem_page + seg->read_bytes + seg->zero_bytes;
+      if (end > t->heap_start)
+        t->heap_start = end;
+    }
+
+  /* The heap starts out empty, at the page after the last
+     segment. */
+  t->brk = t->heap_start;
+
+  /* Map small programs in full, and the start of each segment of
+     larger ones, instead of taking a fault on each page. */
+  for (i = 0; i < image->seg_cnt; i++)
+    {
+      struct exec_segment *seg = &image->segs[i];
+      size_t cnt = (seg->read_bytes + seg->zero_bytes) / PGSIZE;
+      if (page_cnt > PREFAULT_SMALL_PAGES && cnt > PREFAULT_PAGES)
+        cnt = PREFAULT_PAGES;
+      page_prefault ((uint8_t *) seg->mem_page, cnt);
+    }
 
   /* Set up stack. */
-  if (!setup_stack (esp, file_name, save_ptr))
+  if (!setup_stack (esp, cmd_line, argc, args_size))
     goto done;
 
   /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
+  *eip = image->entry;
 
   success = true;
 
  done:
   /* We arrive here whether the load is successful or not. */
-  lock_release(&filesys_lock);
+  free (image);
   return success;
 }
-
+
 /* load() helpers. */
 
 /* Checks whether PHDR describes a valid, loadable segment in
@@ -487,74 +1227,65 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
-static bool
-setup_stack (void **esp, const char* file_name, char** save_ptr) 
+/* Splits CMD_LINE into words in place, squeezing out the spaces
+   so that the words follow one another, each ending in a null
+   byte.  Returns the number of words and stores the number of
+   bytes they take up in *SIZE. */
+static int
+split_args (char *cmd_line, size_t *size)
 {
-  bool success = grow_stack(((uint8_t *) PHYS_BASE) - PGSIZE);
-  if (success)
-    *esp = PHYS_BASE;
-  else
-    {
-      return success;
-    }
+  char *src = cmd_line, *dst = cmd_line;
+  int argc = 0;
 
-  char *token;
-  char **argv = malloc(DEFAULT_ARGV*sizeof(char *));
-  if (!argv)
+  for (;;)
     {
-      return false;
+      while (*src == ' ')
+        src++;
+      if (*src == '\0')
+        break;
+      while (*src != ' ' && *src != '\0')
+        *dst++ = *src++;
+      *dst++ = '\0';
+      argc++;
     }
-  int i, argc = 0, argv_size = DEFAULT_ARGV;
+  *size = dst - cmd_line;
+  return argc;
+}
 
-  // Push args onto stack
-  for (token = (char *) file_name; token != NULL;
-       token = strtok_r (NULL, " ", save_ptr))
-    {
-      *esp -= strlen(token) + 1;
-      argv[argc] = *esp;
-      argc++;
-      // Resize argv
-      if (argc >= argv_size)
-	{
-	  argv_size *= 2;
-	  argv = realloc(argv, argv_size*sizeof(char *));
-	  if (!argv)
-	    {
-	      return false;
-	    }
-	}
-      memcpy(*esp, token, strlen(token) + 1);
-    }
-  argv[argc] = 0;
-  // Align to word size (4 bytes)
-  i = (size_t) *esp % WORD_SIZE;
-  if (i)
-    {
-      *esp -= i;
-      memcpy(*esp, &argv[argc], i);
-    }
-  // Push argv[i] for all i
-  for (i = argc; i >= 0; i--)
-    {
-      *esp -= sizeof(char *);
-      memcpy(*esp, &argv[i], sizeof(char *));
-    }
-  // Push argv
-  token = *esp;
-  *esp -= sizeof(char **);
-  memcpy(*esp, &token, sizeof(char **));
-  // Push argc
-  *esp -= sizeof(int);
-  memcpy(*esp, &argc, sizeof(int));
-  // Push fake return addr
-  *esp -= sizeof(void *);
-  memcpy(*esp, &argv[argc], sizeof(void *));
-  // Free argv
-  free(argv);
+/* Create a minimal stack by mapping a zeroed page at the top of
+   user virtual memory, then push the ARGC words in ARGS, which
+   take up SIZE bytes, as the arguments to main(). */
+static bool
+setup_stack (void **esp, const char *args, int argc, size_t size)
+{
+  char **argv;
+  uint32_t *sp;
+  int i;
 
-  return success;
+  /* The words, argv[], and main()'s three arguments must all fit
+     in the one page. */
+  if (ROUND_UP (size, sizeof *sp) + (argc + 4) * sizeof *sp > PGSIZE)
+    return false;
+  if (!grow_stack (((uint8_t *) PHYS_BASE) - PGSIZE))
+    return false;
+
+  /* Copy the words to the top of the stack, and point argv[] at
+     them from just below, word-aligned. */
+  memcpy ((char *) PHYS_BASE - size, args, size);
+  argv = (char **) ROUND_DOWN ((uintptr_t) PHYS_BASE - size, sizeof *sp);
+  argv -= argc + 1;
+  argv[0] = (char *) PHYS_BASE - size;
+  for (i = 1; i < argc; i++)
+    argv[i] = argv[i - 1] + strlen (argv[i - 1]) + 1;
+  argv[argc] = NULL;
+
+  /* Push argv, argc, and a fake return address. */
+  sp = (uint32_t *) argv;
+  *--sp = (uint32_t) argv;
+  *--sp = argc;
+  *--sp = 0;
+  *esp = sp;
+  return true;
 }
 
 /* Adds a mapping from user virtual address UPAGE to kernel
@@ -577,78 +1308,152 @@ bool install_page (void *upage, void *kpage, bool writable)
 }
 
 
-int process_add_file (struct file *f)
+/* Number of slots in a new fd table. */
+#define FD_TABLE_MIN 16
+
+/* Returns the lowest free slot in the current process's fd table,
+   growing the table if it is full, or -1 if memory is short.  The
+   caller must hold files_lock. */
+static int alloc_fd (void)
 {
-  struct process_file *pf = malloc(sizeof(struct process_file));
-  if (!pf)
+  struct thread *t = process_current();
+  int fd;
+
+  for (fd = t->fd; fd < t->file_cnt; fd++)
     {
-      return ERROR;
+      if (!t->files[fd])
+	{
+	  break;
+	}
+    }
+  if (fd >= t->file_cnt)
+    {
+      int cnt = t->file_cnt ? t->file_cnt * 2 : FD_TABLE_MIN;
+      struct process_file **files = realloc(t->files, cnt * sizeof *files);
+      if (!files)
+	{
+	  return ERROR;
+	}
+      memset(files + t->file_cnt, 0, (cnt - t->file_cnt) * sizeof *files);
+      t->files = files;
+      t->file_cnt = cnt;
     }
-  pf->file = f;
-  pf->dir = NULL;
-  pf->isdir = false;
-  pf->fd = thread_current()->fd;
-  thread_current()->fd++;
-  list_push_back(&thread_current()->file_list, &pf->elem);
-  return pf->fd;
+  t->fd = fd + 1;
+  return fd;
 }
 
-int process_add_dir (struct dir *dir)
+/* Puts a new slot for FILE or DIR in the current process's fd
+   table and returns its fd, or ERROR if memory is short. */
+static int add_slot (struct file *file, struct dir *dir)
 {
-  struct process_file *pf = malloc(sizeof(struct process_file));
+  struct thread *t = process_current();
+  struct process_file *pf = malloc(sizeof *pf);
+  int fd;
+
   if (!pf)
     {
       return ERROR;
     }
-  pf->dir = dir;
-  pf->file = NULL;
-  pf->isdir = true;
-  pf->fd = thread_current()->fd;
-  thread_current()->fd++;
-  list_push_back(&thread_current()->file_list, &pf->elem);
-  return pf->fd;
+  lock_acquire(&t->files_lock);
+  fd = alloc_fd();
+  if (fd != ERROR)
+    {
+      pf->file = file;
+      pf->dir = dir;
+      pf->fd = fd;
+      pf->isdir = dir != NULL;
+      pf->ref_cnt = 1;
+      t->files[fd] = pf;
+    }
+  lock_release(&t->files_lock);
+  if (fd == ERROR)
+    {
+      free(pf);
+    }
+  return fd;
+}
+
+int process_add_file (struct file *f)
+{
+  return add_slot(f, NULL);
+}
+
+int process_add_dir (struct dir *dir)
+{
+  return add_slot(NULL, dir);
 }
 
+/* Returns the slot for FD in the current process's fd table with
+   a reference that the caller drops with process_put_file(), or a
+   null pointer if FD is not open.  The slot stays usable even if
+   another thread closes FD meanwhile. */
 struct process_file* process_get_file (int fd)
 {
-  struct thread *t = thread_current();
-  struct list_elem *e;
+  struct thread *t = process_current();
+  struct process_file *pf = NULL;
 
-  for (e = list_begin (&t->file_list); e != list_end (&t->file_list);
-       e = list_next (e))
-        {
-          struct process_file *pf = list_entry (e, struct process_file, elem);
-          if (fd == pf->fd)
-	    {
-	      return pf;
-	    }
-        }
-  return NULL;
+  lock_acquire(&t->files_lock);
+  if (fd >= MIN_FD && fd < t->file_cnt && t->files[fd])
+    {
+      pf = t->files[fd];
+      pf->ref_cnt++;
+    }
+  lock_release(&t->files_lock);
+  return pf;
+}
+
+/* Drops a reference to PF, closing its file or directory when the
+   last one goes. */
+void process_put_file (struct process_file *pf)
+{
+  struct thread *t = process_current();
+  bool last;
+
+  lock_acquire(&t->files_lock);
+  last = --pf->ref_cnt == 0;
+  lock_release(&t->files_lock);
+  if (last)
+    {
+      if (pf->isdir)
+	dir_close(pf->dir);
+      else
+	file_close(pf->file);
+      free(pf);
+    }
 }
 
 void process_close_file (int fd)
 {
-  struct thread *t = thread_current();
-  struct list_elem *next, *e = list_begin(&t->file_list);
+  struct thread *t = process_current();
+  struct process_file *pf = NULL;
 
-  while (e != list_end (&t->file_list))
+  if (fd == CLOSE_ALL)
     {
-      next = list_next(e);
-      struct process_file *pf = list_entry (e, struct process_file, elem);
-      if (fd == pf->fd || fd == CLOSE_ALL)
+      for (fd = MIN_FD; fd < t->file_cnt; fd++)
 	{
-	  if (pf->isdir)
-		dir_close(pf->dir);
-	  else 
-		file_close(pf->file);
-	  list_remove(&pf->elem);
-	  free(pf);
-	  if (fd != CLOSE_ALL)
-	    {
-	      return;
-	    }
+	  process_close_file(fd);
 	}
-      e = next;
+      free(t->files);
+      t->files = NULL;
+      t->file_cnt = 0;
+      t->fd = MIN_FD;
+      return;
+    }
+
+  lock_acquire(&t->files_lock);
+  if (fd >= MIN_FD && fd < t->file_cnt && t->files[fd])
+    {
+      pf = t->files[fd];
+      t->files[fd] = NULL;
+      if (fd < t->fd)
+	{
+	  t->fd = fd;
+	}
+    }
+  lock_release(&t->files_lock);
+  if (pf)
+    {
+      process_put_file(pf);
     }
 }
 
@@ -660,14 +1465,14 @@ bool process_add_mmap (struct sup_page_entry *spte)
       return false;
     }
   mm->spte = spte;
-  mm->mapid = thread_current()->mapid;
-  list_push_back(&thread_current()->mmap_list, &mm->elem);
+  mm->mapid = process_current()->mapid;
+  list_push_back(&process_current()->mmap_list, &mm->elem);
   return true;
 }
 
 void process_remove_mmap (int mapping)
 {
-  struct thread *t = thread_current();
+  struct thread *t = process_current();
   struct list_elem *next, *e = list_begin(&t->mmap_list);
   struct file *f = NULL;
   int close = 0;
@@ -676,17 +1481,30 @@ void process_remove_mmap (int mapping)
     {
       next = list_next(e);
       struct mmap_file *mm = list_entry (e, struct mmap_file, elem);
-      if (mm->mapid == mapping || mapping == CLOSE_ALL)
+      if ((mm->mapid == mapping || mapping == CLOSE_ALL) && mm->spte->anon)
+	{
+	  // Nothing to write back: drop the page wherever it is.
+	  if (mm->spte->type == HASH_ERROR)
+	    {
+	      free(mm->spte);
+	    }
+	  else
+	    {
+	      page_remove(mm->spte);
+	    }
+	  list_remove(&mm->elem);
+	  free(mm);
+	  t->anon_pages--;
+	}
+      else if (mm->mapid == mapping || mapping == CLOSE_ALL)
 	{
 	  mm->spte->pinned = true;
 	  if (mm->spte->is_loaded)
 	    {
 	      if (pagedir_is_dirty(t->pagedir, mm->spte->uva))
 		{
-		  lock_acquire(&filesys_lock);
 		  file_write_at(mm->spte->file, mm->spte->uva,
 				mm->spte->read_bytes, mm->spte->offset);
-		  lock_release(&filesys_lock);
 		}
 	      frame_free(pagedir_get_page(t->pagedir, mm->spte->uva));
 	      pagedir_clear_page(t->pagedir, mm->spte->uva);
@@ -700,9 +1518,7 @@ void process_remove_mmap (int mapping)
 	    {
 	      if (f)
 		{
-		  lock_acquire(&filesys_lock);
 		  file_close(f);
-		  lock_release(&filesys_lock);
 		}
 	      close = mm->mapid;
 	      f = mm->spte->file;
@@ -714,8 +1530,6 @@ void process_remove_mmap (int mapping)
     }
   if (f)
     {
-      lock_acquire(&filesys_lock);
       file_close(f);
-      lock_release(&filesys_lock);
     }
 }
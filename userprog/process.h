@@ -2,12 +2,15 @@
 #define USERPROG_PROCESS_H
 
 #include "threads/thread.h"
+/* An open file or directory, in a slot of the fd table.  Threads
+   using it hold references, so it outlives close() until they are
+   done with it. */
 struct process_file {
   struct file *file;
   struct dir *dir;
   int fd;
   bool isdir;
-  struct list_elem elem;
+  int ref_cnt;			// Guarded by the process's files_lock
 };
 
 struct mmap_file {
@@ -19,8 +22,17 @@ struct mmap_file {
 int process_add_file (struct file *f);
 int process_add_dir (struct dir *dir);
 struct process_file* process_get_file (int fd);
+void process_put_file (struct process_file *pf);
+void process_init (void);
+void exec_cache_drop_removed (void);
+void exec_cache_flush (void);
 tid_t process_execute (const char *file_name);
+tid_t process_fork (struct intr_frame *f);
+tid_t process_spawn (void (*start) (void), void *func, void *aux);
+int process_join (tid_t);
+void process_thread_end (int status) NO_RETURN;
 int process_wait (tid_t);
+void rusage_add (struct rusage *dst, const struct rusage *src);
 void process_exit (void);
 void process_activate (void);
 bool install_page (void *upage, void *kpage, bool writable);
@@ -1,5 +1,10 @@
 #include "userprog/syscall.h"
+#include <limits.h>
+#include <rdtsc.h>
+#include <round.h>
 #include <stdio.h>
+#include <string.h>
+#include <syscall-names.h>
 #include <syscall-nr.h>
 #include <user/syscall.h>
 #include "devices/input.h"
@@ -8,199 +13,508 @@
 #include "filesys/filesys.h"
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/aio.h"
+#include "userprog/futex.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
+#include "userprog/usercopy.h"
 #include "vm/frame.h"
 #include "vm/page.h"
 
-#define MAX_ARGS 3
+#define MAX_ARGS 4
 
 static void syscall_handler (struct intr_frame *);
-void get_arg (struct intr_frame *f, int *arg, int n);
-struct sup_page_entry* check_valid_ptr (const void *vaddr, void* esp);
-void check_valid_buffer (void* buffer, unsigned size, void* esp,
-			 bool to_write);
-void check_valid_string (const void* str, void* esp);
-void check_write_permission (struct sup_page_entry *spte);
-void unpin_ptr (void* vaddr);
-void unpin_string (void* str);
-void unpin_buffer (void* buffer, unsigned size);
+static char *copy_in_string (const char *ustr);
+static int read_user (int fd, void *buffer, unsigned size, off_t *pos);
+static int write_user (int fd, const void *buffer, unsigned size,
+		       off_t *pos);
+static int read_kernel (int fd, void *buffer, unsigned size, off_t *pos);
+static int write_kernel (int fd, const void *buffer, unsigned size,
+			 off_t *pos);
+static bool copy_in_iovec (struct iovec *kiov, const struct iovec *iov,
+			   int iovcnt);
+
+/* Guards every process's children table and exited_children list,
+   the records in them, and each child's cp pointer. */
+static struct lock child_lock;
 
 void
 syscall_init (void) 
 {
-  lock_init(&filesys_lock);
+  aio_init();
+  futex_init();
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
+/* A system call: how many argument words it takes, which of them
+   are user strings to be copied into the kernel before the call,
+   and a wrapper that unpacks the words and calls the
+   implementation. */
+typedef uint32_t syscall_func (uint32_t *arg);
+struct syscall
+  {
+    syscall_func *func;         /* Wrapper; null if unimplemented. */
+    int argc;                   /* Number of argument words. */
+    unsigned strings;           /* Bit I set: argument I is a string. */
+  };
+
+static syscall_func sys_halt, sys_exit, sys_exec, sys_wait, sys_create,
+  sys_remove, sys_open, sys_filesize, sys_read, sys_write, sys_seek,
+  sys_tell, sys_close, sys_mmap, sys_munmap, sys_chdir, sys_mkdir,
+  sys_readdir, sys_isdir, sys_inumber, sys_pread, sys_pwrite, sys_readv,
+  sys_writev, sys_sysstats, sys_copy_file_range, sys_aio_setup,
+  sys_aio_enter, sys_fork, sys_getrusage, sys_wait_any,
+  sys_sbrk, sys_mmap_anon, sys_thread_spawn, sys_thread_join,
+  sys_thread_end, sys_futex_wait, sys_futex_wake;
+
+/* System calls, indexed by number. */
+static const struct syscall syscalls[] =
+  {
+    [SYS_HALT] = {sys_halt, 0, 0},
+    [SYS_EXIT] = {sys_exit, 1, 0},
+    [SYS_EXEC] = {sys_exec, 1, 1 << 0},
+    [SYS_WAIT] = {sys_wait, 1, 0},
+    [SYS_CREATE] = {sys_create, 2, 1 << 0},
+    [SYS_REMOVE] = {sys_remove, 1, 1 << 0},
+    [SYS_OPEN] = {sys_open, 1, 1 << 0},
+    [SYS_FILESIZE] = {sys_filesize, 1, 0},
+    [SYS_READ] = {sys_read, 3, 0},
+    [SYS_WRITE] = {sys_write, 3, 0},
+    [SYS_SEEK] = {sys_seek, 2, 0},
+    [SYS_TELL] = {sys_tell, 1, 0},
+    [SYS_CLOSE] = {sys_close, 1, 0},
+    [SYS_MMAP] = {sys_mmap, 2, 0},
+    [SYS_MUNMAP] = {sys_munmap, 1, 0},
+    [SYS_CHDIR] = {sys_chdir, 1, 1 << 0},
+    [SYS_MKDIR] = {sys_mkdir, 1, 1 << 0},
+    [SYS_READDIR] = {sys_readdir, 2, 0},
+    [SYS_ISDIR] = {sys_isdir, 1, 0},
+    [SYS_INUMBER] = {sys_inumber, 1, 0},
+    [SYS_PREAD] = {sys_pread, 4, 0},
+    [SYS_PWRITE] = {sys_pwrite, 4, 0},
+    [SYS_READV] = {sys_readv, 3, 0},
+    [SYS_WRITEV] = {sys_writev, 3, 0},
+    [SYS_SYSSTATS] = {sys_sysstats, 3, 0},
+    [SYS_COPY_FILE_RANGE] = {sys_copy_file_range, 3, 0},
+    [SYS_AIO_SETUP] = {sys_aio_setup, 1, 0},
+    [SYS_AIO_ENTER] = {sys_aio_enter, 1, 0},
+    [SYS_FORK] = {sys_fork, 0, 0},
+    [SYS_GETRUSAGE] = {sys_getrusage, 2, 0},
+    [SYS_WAIT_ANY] = {sys_wait_any, 1, 0},
+    [SYS_SBRK] = {sys_sbrk, 1, 0},
+    [SYS_MMAP_ANON] = {sys_mmap_anon, 2, 0},
+    [SYS_THREAD_SPAWN] = {sys_thread_spawn, 3, 0},
+    [SYS_THREAD_JOIN] = {sys_thread_join, 1, 0},
+    [SYS_THREAD_END] = {sys_thread_end, 1, 0},
+    [SYS_FUTEX_WAIT] = {sys_futex_wait, 2, 0},
+    [SYS_FUTEX_WAKE] = {sys_futex_wake, 2, 0},
+  };
+
+bool syscall_print_stats_enabled;
+
+/* Statistics for all processes together, indexed by number.
+   Updated with interrupts off, like each process's. */
+static struct sysstat global_stats[SYS_CNT];
+
+/* Adds a call that took CYCLES to ST. */
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
-{
-  int arg[MAX_ARGS];
-  check_valid_ptr((const void*) f->esp, f->esp);
-  switch (* (int *) f->esp)
-    {
-    case SYS_HALT:
-      {
-	halt(); 
-	break;
-      }
-    case SYS_EXIT:
-      {
-	get_arg(f, &arg[0], 1);
-	exit(arg[0]);
-	break;
-      }
-    case SYS_EXEC:
-      {
-	get_arg(f, &arg[0], 1);
-	check_valid_string((const void *) arg[0], f->esp);
-	f->eax = exec((const char *) arg[0]);
-	unpin_string((void *) arg[0]);
-	break;
-      }
-    case SYS_WAIT:
-      {
-	get_arg(f, &arg[0], 1);
-	f->eax = wait(arg[0]);
-	break;
-      }
-    case SYS_CREATE:
-      {
-	get_arg(f, &arg[0], 2);
-	check_valid_string((const void *) arg[0], f->esp);
-	f->eax = create((const char *)arg[0], (unsigned) arg[1]);
-	unpin_string((void *) arg[0]);
-	break;
-      }
-    case SYS_REMOVE:
-      {
-	get_arg(f, &arg[0], 1);
-	check_valid_string((const void *) arg[0], f->esp);
-	f->eax = remove((const char *) arg[0]);
-	break;
-      }
-    case SYS_OPEN:
-      {
-	get_arg(f, &arg[0], 1);
-	check_valid_string((const void *) arg[0], f->esp);
-	f->eax = open((const char *) arg[0]);
-	unpin_string((void *) arg[0]);
-	break; 		
-      }
-    case SYS_FILESIZE:
-      {
-	get_arg(f, &arg[0], 1);
-	f->eax = filesize(arg[0]);
-	break;
-      }
-    case SYS_READ:
-      {
-	get_arg(f, &arg[0], 3);
-	check_valid_buffer((void *) arg[1], (unsigned) arg[2], f->esp,
-			   true);
-	f->eax = read(arg[0], (void *) arg[1], (unsigned) arg[2]);
-	unpin_buffer((void *) arg[1], (unsigned) arg[2]);
-	break;
-      }
-    case SYS_WRITE:
-      { 
-	get_arg(f, &arg[0], 3);
-	check_valid_buffer((void *) arg[1], (unsigned) arg[2], f->esp,
-			   false);
-	f->eax = write(arg[0], (const void *) arg[1],
-		       (unsigned) arg[2]);
-	unpin_buffer((void *) arg[1], (unsigned) arg[2]);
-	break;
-      }
-    case SYS_SEEK:
-      {
-	get_arg(f, &arg[0], 2);
-	seek(arg[0], (unsigned) arg[1]);
-	break;
-      } 
-    case SYS_TELL:
-      { 
-	get_arg(f, &arg[0], 1);
-	f->eax = tell(arg[0]);
-	break;
-      }
-    case SYS_CLOSE:
-      { 
-	get_arg(f, &arg[0], 1);
-	close(arg[0]);
-	break;
-      }
-    case SYS_MMAP:
-      {
-	get_arg(f, &arg[0], 2);
-	f->eax = mmap(arg[0], (void *) arg[1]);
-	break;
-      }
-    case SYS_MUNMAP:
-      {
-	get_arg(f, &arg[0], 1);
-	munmap(arg[0]);
-	break;
-      }
-    	case SYS_CHDIR:
+record_stat (struct sysstat *st, uint64_t cycles)
+{
+  int bucket = 0;
+  if (cycles >> 32)
+    {
+      bucket = SYSSTAT_BUCKETS - 1;
+    }
+  else if ((uint32_t) cycles >> SYSSTAT_SHIFT)
+    {
+      bucket = 31 - __builtin_clz((uint32_t) cycles) - SYSSTAT_SHIFT;
+      if (bucket >= SYSSTAT_BUCKETS)
 	{
-		get_arg(f, &arg[0], 1);
-		check_valid_string((const void *) arg[0], f->esp);
-		f->eax = chdir((const char *)arg[0]); 
-		break;
+	  bucket = SYSSTAT_BUCKETS - 1;
 	}
-	case SYS_MKDIR:
+    }
+  st->count++;
+  st->cycles += cycles;
+  st->hist[bucket]++;
+}
+
+/* Fetches the system call number and then all of its arguments
+   with one copy each, copies string arguments into the kernel,
+   and calls the implementation through the table.  Bad pointers
+   and unknown numbers terminate the process. */
+static void
+syscall_handler (struct intr_frame *f) 
+{
+  uint32_t arg[MAX_ARGS];
+  const struct syscall *sc;
+  struct thread *t = thread_current();
+  uint64_t start = rdtsc();
+  unsigned number;
+  int i;
+
+  t->esp = f->esp;
+  t->frame = f;
+  if (!copy_from_user(&number, f->esp, sizeof number))
+    {
+      exit(ERROR);
+    }
+  if (number >= sizeof syscalls / sizeof *syscalls
+      || syscalls[number].func == NULL)
+    {
+      exit(ERROR);
+    }
+  sc = &syscalls[number];
+  if (!copy_from_user(arg, (uint32_t *) f->esp + 1, sc->argc * sizeof *arg))
+    {
+      exit(ERROR);
+    }
+  for (i = 0; i < sc->argc; i++)
+    {
+      if (sc->strings & (1u << i))
 	{
-		get_arg(f, &arg[0], 1);
-		check_valid_string((const void *) arg[0], f->esp);
-		f->eax = mkdir(arg[0]);
-		break;
+	  arg[i] = (uint32_t) copy_in_string((const char *) arg[i]);
 	}
-	case SYS_READDIR:
+    }
+  f->eax = sc->func(arg);
+  for (i = 0; i < sc->argc; i++)
+    {
+      if (sc->strings & (1u << i))
+	{
+	  palloc_free_page((void *) arg[i]);
+	}
+    }
+
+  uint64_t cycles = rdtsc() - start;
+  struct thread *p = process_current();
+  enum intr_level old_level;
+  if (!p->sysstats)
+    {
+      // Another thread of the process may get there first.
+      struct sysstat *stats = calloc(SYS_CNT, sizeof *stats);
+      old_level = intr_disable();
+      if (!p->sysstats)
 	{
-		get_arg(f, &arg[0], 2);
-		check_valid_string((const void *) arg[1], f->esp);
-		f->eax = readdir(arg[0],arg[1]);
-		break;
+	  p->sysstats = stats;
+	  stats = NULL;
 	}
-	case SYS_ISDIR:
+      intr_set_level(old_level);
+      free(stats);
+    }
+  old_level = intr_disable();
+  record_stat(&global_stats[number], cycles);
+  if (p->sysstats)
+    {
+      record_stat(&p->sysstats[number], cycles);
+    }
+  intr_set_level(old_level);
+}
+
+/* Prints the nonzero entries of STATS, indexed by number. */
+static void
+print_stats (const struct sysstat *stats)
+{
+  int number, i;
+  for (number = 0; number < SYS_CNT; number++)
+    {
+      const struct sysstat *st = &stats[number];
+      if (st->count == 0)
 	{
-		get_arg(f, &arg[0], 1);
-		f->eax = isdir(arg[0]);
-		break;
+	  continue;
 	}
-	case SYS_INUMBER:
+      printf("  %-15s %7u calls, %10llu cycles avg, histogram:",
+	     syscall_names[number], st->count, st->cycles / st->count);
+      for (i = 0; i < SYSSTAT_BUCKETS; i++)
 	{
-		get_arg(f, &arg[0], 1);
-		f->eax = inumber(arg[0]);
-		break;
+	  printf(" %u", st->hist[i]);
 	}
+      printf("\n");
     }
-  unpin_ptr(f->esp);
 }
 
-int mmap (int fd, void *addr)
+/* Prints the current process's statistics, if enabled, and frees
+   them.  Called at process exit, once the process's other threads
+   are gone. */
+void
+syscall_exit_stats (void)
 {
-  struct process_file *pf = process_get_file(fd);
-  if(!pf || pf->isdir)
-	return ERROR;
+  struct thread *t = thread_current();
+  if (syscall_print_stats_enabled && t->sysstats)
+    {
+      printf("%s: system calls:\n", t->name);
+      print_stats(t->sysstats);
+    }
+  free(t->sysstats);
+  t->sysstats = NULL;
+}
+
+/* Prints statistics for all processes, if enabled. */
+void
+syscall_print_stats (void)
+{
+  if (syscall_print_stats_enabled)
+    {
+      printf("System calls:\n");
+      print_stats(global_stats);
+    }
+}
+
+/* Copies up to CNT entries of the global statistics, if GLOBAL,
+   otherwise of the current process's, counting all of its
+   threads, to user array STATS.  Returns the number of entries
+   available, SYS_CNT. */
+int sysstats (bool global, struct sysstat *stats, int cnt)
+{
+  static const struct sysstat zeros[SYS_CNT];
+  struct sysstat snapshot[SYS_CNT];
+  const struct sysstat *src = zeros;
+
+  if (cnt < 0)
+    {
+      return ERROR;
+    }
+  if (cnt > SYS_CNT)
+    {
+      cnt = SYS_CNT;
+    }
+  enum intr_level old_level = intr_disable();
+  if (global || process_current()->sysstats)
+    {
+      memcpy(snapshot, global ? global_stats : process_current()->sysstats,
+	     sizeof snapshot);
+      src = snapshot;
+    }
+  intr_set_level(old_level);
+  if (!copy_to_user(stats, src, cnt * sizeof *stats))
+    {
+      exit(ERROR);
+    }
+  return SYS_CNT;
+}
+
+/* Wrappers that unpack argument words for the table above. */
+static uint32_t sys_halt (uint32_t *arg UNUSED)
+{
+  halt();
+}
+
+static uint32_t sys_exit (uint32_t *arg)
+{
+  exit(arg[0]);
+}
+
+static uint32_t sys_exec (uint32_t *arg)
+{
+  return exec((const char *) arg[0]);
+}
+
+static uint32_t sys_wait (uint32_t *arg)
+{
+  return wait(arg[0]);
+}
+
+static uint32_t sys_create (uint32_t *arg)
+{
+  return create((const char *) arg[0], arg[1]);
+}
+
+static uint32_t sys_remove (uint32_t *arg)
+{
+  return remove((const char *) arg[0]);
+}
+
+static uint32_t sys_open (uint32_t *arg)
+{
+  return open((const char *) arg[0]);
+}
+
+static uint32_t sys_filesize (uint32_t *arg)
+{
+  return filesize(arg[0]);
+}
+
+static uint32_t sys_read (uint32_t *arg)
+{
+  return read(arg[0], (void *) arg[1], arg[2]);
+}
+
+static uint32_t sys_write (uint32_t *arg)
+{
+  return write(arg[0], (const void *) arg[1], arg[2]);
+}
+
+static uint32_t sys_seek (uint32_t *arg)
+{
+  seek(arg[0], arg[1]);
+  return 0;
+}
+
+static uint32_t sys_tell (uint32_t *arg)
+{
+  return tell(arg[0]);
+}
+
+static uint32_t sys_close (uint32_t *arg)
+{
+  close(arg[0]);
+  return 0;
+}
+
+static uint32_t sys_mmap (uint32_t *arg)
+{
+  return mmap(arg[0], (void *) arg[1]);
+}
 
-  struct file *old_file = pf->file;
-  if (!old_file || !is_user_vaddr(addr) || addr < USER_VADDR_BOTTOM ||
+static uint32_t sys_munmap (uint32_t *arg)
+{
+  munmap(arg[0]);
+  return 0;
+}
+
+static uint32_t sys_chdir (uint32_t *arg)
+{
+  return chdir((const char *) arg[0]);
+}
+
+static uint32_t sys_mkdir (uint32_t *arg)
+{
+  return mkdir((const char *) arg[0]);
+}
+
+static uint32_t sys_readdir (uint32_t *arg)
+{
+  return readdir(arg[0], (char *) arg[1]);
+}
+
+static uint32_t sys_isdir (uint32_t *arg)
+{
+  return isdir(arg[0]);
+}
+
+static uint32_t sys_inumber (uint32_t *arg)
+{
+  return inumber(arg[0]);
+}
+
+static uint32_t sys_pread (uint32_t *arg)
+{
+  return pread(arg[0], (void *) arg[1], arg[2], arg[3]);
+}
+
+static uint32_t sys_pwrite (uint32_t *arg)
+{
+  return pwrite(arg[0], (const void *) arg[1], arg[2], arg[3]);
+}
+
+static uint32_t sys_readv (uint32_t *arg)
+{
+  return readv(arg[0], (const struct iovec *) arg[1], arg[2]);
+}
+
+static uint32_t sys_writev (uint32_t *arg)
+{
+  return writev(arg[0], (const struct iovec *) arg[1], arg[2]);
+}
+
+static uint32_t sys_sysstats (uint32_t *arg)
+{
+  return sysstats(arg[0], (struct sysstat *) arg[1], arg[2]);
+}
+
+static uint32_t sys_copy_file_range (uint32_t *arg)
+{
+  return copy_file_range(arg[0], arg[1], arg[2]);
+}
+
+static uint32_t sys_aio_setup (uint32_t *arg)
+{
+  return aio_setup((struct aio_ring *) arg[0]);
+}
+
+static uint32_t sys_aio_enter (uint32_t *arg)
+{
+  return aio_enter(arg[0]);
+}
+
+static uint32_t sys_fork (uint32_t *arg UNUSED)
+{
+  return fork();
+}
+
+static uint32_t sys_getrusage (uint32_t *arg)
+{
+  return getrusage(arg[0], (struct rusage *) arg[1]);
+}
+
+static uint32_t sys_wait_any (uint32_t *arg)
+{
+  return wait_any((int *) arg[0]);
+}
+
+static uint32_t sys_sbrk (uint32_t *arg)
+{
+  return (uint32_t) sbrk(arg[0]);
+}
+
+static uint32_t sys_mmap_anon (uint32_t *arg)
+{
+  return mmap_anon((void *) arg[0], arg[1]);
+}
+
+// The user library passes its start routine first; see
+// process_spawn().
+static uint32_t sys_thread_spawn (uint32_t *arg)
+{
+  tid_t tid = process_spawn((void (*) (void)) arg[0], (void *) arg[1],
+			    (void *) arg[2]);
+  return tid == TID_ERROR ? THRID_ERROR : tid;
+}
+
+static uint32_t sys_thread_join (uint32_t *arg)
+{
+  return thread_join(arg[0]);
+}
+
+static uint32_t sys_thread_end (uint32_t *arg)
+{
+  thread_end(arg[0]);
+}
+
+static uint32_t sys_futex_wait (uint32_t *arg)
+{
+  return futex_wait((int *) arg[0], arg[1]);
+}
+
+static uint32_t sys_futex_wake (uint32_t *arg)
+{
+  return futex_wake((int *) arg[0], arg[1]);
+}
+
+int mmap (int fd, void *addr)
+{
+  if (!is_user_vaddr(addr) || addr < USER_VADDR_BOTTOM ||
       ((uint32_t) addr % PGSIZE) != 0)
     {
       return ERROR;
     }
-  struct file *file = file_reopen(old_file);
-  if (!file || file_length(old_file) == 0)
+  struct process_file *pf = process_get_file(fd);
+  if (!pf)
+    {
+      return ERROR;
+    }
+  struct file *file = pf->isdir ? NULL : file_reopen(pf->file);
+  process_put_file(pf);
+  if (!file || file_length(file) == 0)
     {
+      file_close(file);
       return ERROR;
     }
-  thread_current()->mapid++;
+  struct thread *t = process_current();
+  lock_acquire(&t->vm_lock);
+  int mapid = ++t->mapid;
   int32_t ofs = 0;
   uint32_t read_bytes = file_length(file);
   while (read_bytes > 0)
@@ -210,19 +524,120 @@ int mmap (int fd, void *addr)
       if (!add_mmap_to_page_table(file, ofs,
 				  addr, page_read_bytes, page_zero_bytes))
 	{
-	  munmap(thread_current()->mapid);
-	  return ERROR;
+	  process_remove_mmap(mapid);
+	  mapid = ERROR;
+	  break;
 	}
       read_bytes -= page_read_bytes;
       ofs += page_read_bytes;
       addr += PGSIZE;
   }
-  return thread_current()->mapid;
+  lock_release(&t->vm_lock);
+  return mapid;
+}
+
+// Maps LENGTH bytes at ADDR, rounded up to whole pages, to memory
+// that reads as zeros until written. No frame is taken until a page
+// is touched, and munmap() discards the contents. The mapping must
+// end below the area kept for stacks and keep the process within
+// ANON_MAX_PAGES.
+int mmap_anon (void *addr, size_t length)
+{
+  struct thread *t = process_current();
+  size_t ofs, pages = DIV_ROUND_UP(length, PGSIZE);
+  int mapid;
+
+  if (length == 0 || addr < USER_VADDR_BOTTOM ||
+      (uint8_t *) addr >= THREAD_STACKS_BOTTOM ||
+      ((uint32_t) addr % PGSIZE) != 0 ||
+      length > (size_t) (THREAD_STACKS_BOTTOM - (uint8_t *) addr))
+    {
+      return ERROR;
+    }
+  lock_acquire(&t->vm_lock);
+  if (pages > ANON_MAX_PAGES - t->anon_pages)
+    {
+      lock_release(&t->vm_lock);
+      return ERROR;
+    }
+  mapid = ++t->mapid;
+  for (ofs = 0; ofs < length; ofs += PGSIZE)
+    {
+      if (!add_anon_to_page_table((uint8_t *) addr + ofs))
+	{
+	  process_remove_mmap(mapid);
+	  mapid = ERROR;
+	  break;
+	}
+    }
+  lock_release(&t->vm_lock);
+  return mapid;
 }
 
 void munmap (int mapping)
 {
+  struct thread *t = process_current();
+  lock_acquire(&t->vm_lock);
   process_remove_mmap(mapping);
+  lock_release(&t->vm_lock);
+}
+
+// Moves the current process's break by INCREMENT bytes and returns
+// the old break. Heap pages are zero-filled when first touched, and
+// pages wholly above a lowered break are freed. The heap may not
+// run into a mapping or into the area kept for the stacks.
+void *sbrk (intptr_t increment)
+{
+  struct thread *t = process_current();
+  uint8_t *limit = THREAD_STACKS_BOTTOM;
+  uint8_t *old_brk, *new_brk, *first, *page;
+
+  lock_acquire(&t->vm_lock);
+  old_brk = t->brk;
+  new_brk = old_brk + increment;
+  first = pg_round_up(old_brk);
+  if (increment > limit - old_brk || increment < t->heap_start - old_brk)
+    {
+      lock_release(&t->vm_lock);
+      return (void *) ERROR;
+    }
+  for (page = first; page < new_brk; page += PGSIZE)
+    {
+      if (!add_zero_to_page_table(page))
+	{
+	  // Take back the pages added so far.
+	  while (page > first)
+	    {
+	      page -= PGSIZE;
+	      page_remove(get_spte(page));
+	    }
+	  lock_release(&t->vm_lock);
+	  return (void *) ERROR;
+	}
+    }
+  for (page = pg_round_up(new_brk); page < first; page += PGSIZE)
+    {
+      page_remove(get_spte(page));
+    }
+  t->brk = new_brk;
+  lock_release(&t->vm_lock);
+  return old_brk;
+}
+
+int thread_join (thrid_t tid)
+{
+  return process_join(tid);
+}
+
+// Ends the calling thread. The main thread has no one to join it,
+// so for it this is exit(STATUS).
+void thread_end (int status)
+{
+  if (thread_current()->process == thread_current())
+    {
+      exit(status);
+    }
+  process_thread_end(status);
 }
 
 void halt (void)
@@ -233,10 +648,13 @@ void halt (void)
 void exit (int status)
 {
   struct thread *cur = thread_current();
-  if (thread_alive(cur->parent) && cur->cp)
+  struct thread *p = process_current();
+  lock_acquire(&child_lock);
+  if (p->cp)
     {
-      cur->cp->status = status;
+      p->cp->status = status;
     }
+  lock_release(&child_lock);
   printf ("%s: exit(%d)\n", cur->name, status);
   thread_exit();
 }
@@ -245,6 +663,7 @@ pid_t exec (const char *cmd_line)
 {
   pid_t pid = process_execute(cmd_line);
   struct child_process* cp = get_child_process(pid);
+  // Only this process frees cp, so it stays valid unlocked.
   if (!cp)
     {
       return ERROR;
@@ -266,70 +685,114 @@ int wait (pid_t pid)
   return process_wait(pid);
 }
 
+// Reaps whichever child exits first, or one that already has.
+pid_t wait_any (int *status)
+{
+  int kstatus;
+  pid_t pid = reap_child_process(0, true, &kstatus);
+  if (pid != ERROR && status != NULL
+      && !copy_to_user(status, &kstatus, sizeof kstatus))
+    {
+      exit(ERROR);
+    }
+  return pid;
+}
+
+// The child shares the parent's memory copy-on-write and gets its
+// own descriptors for the parent's open files; see process_fork().
+pid_t fork (void)
+{
+  tid_t tid = process_fork(thread_current()->frame);
+  return tid == TID_ERROR ? ERROR : tid;
+}
+
+/* Namespace operations need no global lock: each directory is
+   protected by its own inode lock and the free map by its own. */
 bool create (const char *file, unsigned initial_size)
 {
-  lock_acquire(&filesys_lock);
-  bool success = filesys_create(file, initial_size, false);
-  lock_release(&filesys_lock);
-  return success;
+  return filesys_create(file, initial_size, false);
 }
 
 bool remove (const char *file)
 {
-  lock_acquire(&filesys_lock);
-  bool success = filesys_remove(file);
-  lock_release(&filesys_lock);
-  return success;
+  return filesys_remove(file);
 }
 
 int open (const char *file)
 {
-  lock_acquire(&filesys_lock);
   struct file *f = filesys_open(file);
   if (!f)
     {
-      lock_release(&filesys_lock);
       return ERROR;
     }
 
   //Distinguish file and directory
   if(inode_isdir(f->inode))
-  {
-	int fd = process_add_dir((struct dir*)f);
-	lock_release(&filesys_lock);
-	return fd;
-  }
+    return process_add_dir((struct dir*)f);
   else
-  { 
-	int fd = process_add_file(f);
-	lock_release(&filesys_lock);
-	return fd;
-  }
+    return process_add_file(f);
 }
 
 int filesize (int fd)
 {
-  lock_acquire(&filesys_lock);
   struct process_file *f = process_get_file(fd);
   if (!f)
     {
-      lock_release(&filesys_lock);
       return ERROR;
     }
-  if (f->isdir)
+  int size = f->isdir ? ERROR : file_length(f->file);
+  process_put_file(f);
+  return size;
+}
+
+/* Reads into user BUFFER through a kernel bounce buffer, a page
+   at a time, so that no lock is held while user memory is
+   touched and a bad BUFFER can fault safely. */
+int read (int fd, void *buffer, unsigned size)
+{
+  return read_user(fd, buffer, size, NULL);
+}
+
+/* Reads like pread() at *POS and advances *POS if POS is
+   nonnull, otherwise like read() at FD's file position. */
+static int read_user (int fd, void *buffer, unsigned size, off_t *pos)
+{
+  uint8_t *kbuf = palloc_get_page(0);
+  unsigned total = 0;
+  int bytes;
+  if (!kbuf)
     {
-      lock_release(&filesys_lock);
       return ERROR;
     }
-
-  int size = file_length(f->file);
-  lock_release(&filesys_lock);
-  return size;
+  do
+    {
+      unsigned chunk = size - total < PGSIZE ? size - total : PGSIZE;
+      bytes = read_kernel(fd, kbuf, chunk, pos);
+      if (bytes <= 0)
+	{
+	  break;
+	}
+      if (!copy_to_user((uint8_t *) buffer + total, kbuf, bytes))
+	{
+	  palloc_free_page(kbuf);
+	  exit(ERROR);
+	}
+      total += bytes;
+      if ((unsigned) bytes < chunk)
+	{
+	  break;
+	}
+    }
+  while (total < size);
+  palloc_free_page(kbuf);
+  return total > 0 ? (int) total : bytes;
 }
 
-int read (int fd, void *buffer, unsigned size)
+/* Reads up to SIZE bytes from FD into kernel buffer BUFFER, at
+   *POS if POS is nonnull. */
+static int read_kernel (int fd, void *buffer, unsigned size, off_t *pos)
 {
-  if (fd == STDIN_FILENO)
+  if (fd == STDIN_FILENO && !pos)
     {
       unsigned i;
       uint8_t* local_buffer = (uint8_t *) buffer;
@@ -337,94 +800,310 @@ int read (int fd, void *buffer, unsigned size)
 	{
 	  local_buffer[i] = input_getc();
 	}
+      thread_current()->rusage.read_bytes += size;
       return size;
     }
-  lock_acquire(&filesys_lock);
   struct process_file *f = process_get_file(fd);
-   if (!f)
+  if (!f)
     {
-      lock_release(&filesys_lock);
       return ERROR;
     }
+
+  int bytes;
   if (f->isdir)
     {
-      lock_release(&filesys_lock);
-      return ERROR;
+      bytes = ERROR;
+    }
+  else if (pos)
+    {
+      bytes = file_read_at(f->file, buffer, size, *pos);
+      *pos += bytes;
+    }
+  else
+    {
+      bytes = file_read(f->file, buffer, size);
+    }
+  process_put_file(f);
+  if (bytes > 0)
+    {
+      thread_current()->rusage.read_bytes += bytes;
     }
-
-  int bytes = file_read(f->file, buffer, size);
-  lock_release(&filesys_lock);
   return bytes;
 }
 
 int write (int fd, const void *buffer, unsigned size)
 {
-  if (fd == STDOUT_FILENO)
+  return write_user(fd, buffer, size, NULL);
+}
+
+/* Writes from user BUFFER through a kernel bounce buffer, a page
+   at a time, at *POS like pwrite() if POS is nonnull. */
+static int write_user (int fd, const void *buffer, unsigned size,
+		       off_t *pos)
+{
+  uint8_t *kbuf = palloc_get_page(0);
+  unsigned total = 0;
+  int bytes;
+  if (!kbuf)
+    {
+      return ERROR;
+    }
+  do
+    {
+      unsigned chunk = size - total < PGSIZE ? size - total : PGSIZE;
+      if (!copy_from_user(kbuf, (const uint8_t *) buffer + total, chunk))
+	{
+	  palloc_free_page(kbuf);
+	  exit(ERROR);
+	}
+      bytes = write_kernel(fd, kbuf, chunk, pos);
+      if (bytes <= 0)
+	{
+	  break;
+	}
+      total += bytes;
+      if ((unsigned) bytes < chunk)
+	{
+	  break;
+	}
+    }
+  while (total < size);
+  palloc_free_page(kbuf);
+  return total > 0 ? (int) total : bytes;
+}
+
+/* Writes SIZE bytes from kernel buffer BUFFER to FD, at *POS if
+   POS is nonnull. */
+static int write_kernel (int fd, const void *buffer, unsigned size,
+			 off_t *pos)
+{
+  if (fd == STDOUT_FILENO && !pos)
     {
       putbuf(buffer, size);
+      thread_current()->rusage.write_bytes += size;
       return size;
     }
-  lock_acquire(&filesys_lock);
   struct process_file *f = process_get_file(fd);
   if (!f)
     {
-      lock_release(&filesys_lock);
       return ERROR;
     }
+  int bytes;
   if (f->isdir)
     {
-      lock_release(&filesys_lock);
+      bytes = ERROR;
+    }
+  else if (pos)
+    {
+      bytes = file_write_at(f->file, buffer, size, *pos);
+      *pos += bytes;
+    }
+  else
+    {
+      bytes = file_write(f->file, buffer, size);
+    }
+  process_put_file(f);
+  if (bytes > 0)
+    {
+      thread_current()->rusage.write_bytes += bytes;
+    }
+  return bytes;
+}
+
+/* Positional and vectored I/O.  pread() and pwrite() leave the
+   file position alone; readv() and writev() use and advance it,
+   stopping at the first short transfer. */
+int pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  off_t pos = offset;
+  if (pos < 0)
+    {
+      return ERROR;
+    }
+  return read_user(fd, buffer, size, &pos);
+}
+
+int pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  off_t pos = offset;
+  if (pos < 0)
+    {
       return ERROR;
     }
-  int bytes = file_write(f->file, buffer, size);
-  lock_release(&filesys_lock);
+  return write_user(fd, buffer, size, &pos);
+}
+
+int readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  struct iovec kiov[IOV_MAX];
+  int total = 0;
+  int i;
+  if (!copy_in_iovec(kiov, iov, iovcnt))
+    {
+      return ERROR;
+    }
+  for (i = 0; i < iovcnt; i++)
+    {
+      int bytes = read_user(fd, kiov[i].iov_base, kiov[i].iov_len, NULL);
+      if (bytes < 0)
+	{
+	  return total > 0 ? total : bytes;
+	}
+      total += bytes;
+      if ((size_t) bytes < kiov[i].iov_len)
+	{
+	  break;
+	}
+    }
+  return total;
+}
+
+int writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  struct iovec kiov[IOV_MAX];
+  int total = 0;
+  int i;
+  if (!copy_in_iovec(kiov, iov, iovcnt))
+    {
+      return ERROR;
+    }
+  for (i = 0; i < iovcnt; i++)
+    {
+      int bytes = write_user(fd, kiov[i].iov_base, kiov[i].iov_len, NULL);
+      if (bytes < 0)
+	{
+	  return total > 0 ? total : bytes;
+	}
+      total += bytes;
+      if ((size_t) bytes < kiov[i].iov_len)
+	{
+	  break;
+	}
+    }
+  return total;
+}
+
+/* Copies the IOVCNT-element user array IOV into KIOV, which has
+   room for IOV_MAX elements.  Returns false if IOVCNT is out of
+   range; terminates the process if IOV is a bad pointer. */
+static bool copy_in_iovec (struct iovec *kiov, const struct iovec *iov,
+			   int iovcnt)
+{
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    {
+      return false;
+    }
+  if (!copy_from_user(kiov, iov, iovcnt * sizeof *kiov))
+    {
+      exit(ERROR);
+    }
+  return true;
+}
+
+/* Copies up to LENGTH bytes from IN_FD to OUT_FD, from and at
+   their current positions, inside the kernel.  Returns the number
+   of bytes copied, which is less than LENGTH at end of IN_FD. */
+int copy_file_range (int in_fd, int out_fd, unsigned length)
+{
+  struct process_file *in = process_get_file(in_fd);
+  struct process_file *out = process_get_file(out_fd);
+  int bytes = ERROR;
+  if (length > INT_MAX)
+    {
+      length = INT_MAX;
+    }
+  if (in && out && !in->isdir && !out->isdir)
+    {
+      bytes = file_copy(out->file, in->file, length);
+    }
+  if (in)
+    {
+      process_put_file(in);
+    }
+  if (out)
+    {
+      process_put_file(out);
+    }
+  if (bytes < 0)
+    {
+      return ERROR;
+    }
+  thread_current()->rusage.read_bytes += bytes;
+  thread_current()->rusage.write_bytes += bytes;
   return bytes;
 }
 
+/* Copies the resource usage of the calling process, or of the
+   children it has waited for, to USAGE.  A process's usage
+   covers the calling thread and the threads that have exited. */
+int getrusage (int who, struct rusage *usage)
+{
+  struct thread *cur = thread_current();
+  struct thread *t = process_current();
+  struct rusage snapshot;
+  enum intr_level old_level;
+
+  if (who != RUSAGE_SELF && who != RUSAGE_CHILDREN)
+    {
+      return ERROR;
+    }
+  // The timer interrupt updates the tick counts.
+  old_level = intr_disable();
+  snapshot = who == RUSAGE_SELF ? t->rusage : t->child_rusage;
+  if (who == RUSAGE_SELF && cur != t)
+    {
+      rusage_add(&snapshot, &cur->rusage);
+    }
+  intr_set_level(old_level);
+  if (!copy_to_user(usage, &snapshot, sizeof snapshot))
+    {
+      exit(ERROR);
+    }
+  return 0;
+}
+
 void seek (int fd, unsigned position)
 {
-  lock_acquire(&filesys_lock);
   struct process_file *f = process_get_file(fd);
   if (!f)
     {
-      lock_release(&filesys_lock);
       return;
     }
-  if (f->isdir)
+  if (!f->isdir)
     {
-      lock_release(&filesys_lock);
-      return;
+      file_seek(f->file, position);
     }
-
-
-  file_seek(f->file, position);
-  lock_release(&filesys_lock);
+  process_put_file(f);
 }
 
 unsigned tell (int fd)
 {
-  lock_acquire(&filesys_lock);
   struct process_file *f = process_get_file(fd);
   if (!f)
     {
-      lock_release(&filesys_lock);
       return ERROR;
     }
-  if (f->isdir)
-    {
-      lock_release(&filesys_lock);
-      return ERROR;	
-    }
-  off_t offset = file_tell(f->file);
-  lock_release(&filesys_lock);
+  off_t offset = f->isdir ? ERROR : file_tell(f->file);
+  process_put_file(f);
   return offset;
 }
 
 void close (int fd)
 {
-  lock_acquire(&filesys_lock);
   process_close_file(fd);
-  lock_release(&filesys_lock);
+}
+
+// Makes DIR the process's working directory and closes the old one.
+static void set_cwd (struct dir *dir)
+{
+  struct thread *t = process_current();
+  struct dir *old;
+
+  lock_acquire(&t->files_lock);
+  old = t->cudir;
+  t->cudir = dir;
+  lock_release(&t->files_lock);
+  dir_close(old);
 }
 
 bool chdir (const char *cmdline)
@@ -442,14 +1121,13 @@ bool chdir (const char *cmdline)
 	{
  		dir_close(dir);
 		dir = dir_open_root();
-                dir_close(thread_current()->cudir);
-		thread_current()->cudir = dir;
+		set_cwd(dir);
 		free(file_name);
 		return true;
 	}
 	else if(strcmp(file_name, ".") == 0 || (inode_get_inumber(dir_get_inode(dir))==ROOT_DIR_SECTOR && strlen(file_name) == 0))
 	{
-		thread_current()->cudir = dir;
+		set_cwd(dir);
 		free(file_name);	
 		return true;
 	}
@@ -463,8 +1141,7 @@ bool chdir (const char *cmdline)
 		}
 		dir_close(dir);
 		dir = dir_open(inode);
-		dir_close(thread_current()->cudir);
-		thread_current()->cudir = dir;
+		set_cwd(dir);
 		free(file_name);
 		return true;
 	}
@@ -478,8 +1155,7 @@ bool chdir (const char *cmdline)
 			free(file_name);
 			return false;
 		}
-		dir_close(thread_current()->cudir);
-		thread_current()->cudir = dir;
+		set_cwd(dir);
 		free(file_name);
 		return true;	
 	}
@@ -490,18 +1166,18 @@ bool mkdir (const char *dir)
 	return filesys_create(dir, 0, true);
 }
 
+/* NAME is a user buffer. */
 bool readdir (int fd, char name[READDIR_MAX_LEN +1])
 {
+	char entry[READDIR_MAX_LEN + 1];
 	struct process_file *file = process_get_file(fd);
 	if(file==NULL)
 		return false;	
-	else if(!file->isdir)
-		return false;
-	bool success = dir_readdir(file->dir, name);
-	if(success)
-		return true;
-	else
-		return false;
+	bool success = file->isdir && dir_readdir(file->dir, entry);
+	process_put_file(file);
+	if(success && !copy_to_user(name, entry, strlen(entry) + 1))
+		exit(ERROR);
+	return success;
 }
 
 bool isdir (int fd)
@@ -512,7 +1188,9 @@ bool isdir (int fd)
   	struct process_file *f = process_get_file(fd);
 	if(f == NULL)
 		return false;
-	return f->isdir;
+	bool result = f->isdir;
+	process_put_file(f);
+	return result;
 }
 
 int inumber (int fd)
@@ -523,168 +1201,241 @@ int inumber (int fd)
   	struct process_file *f = process_get_file(fd);
 	if(f == NULL)
 		return false;
+	int inumber;
 	if(f->isdir)
-		return inode_get_inumber(dir_get_inode(f->dir));
+		inumber = inode_get_inumber(dir_get_inode(f->dir));
 	else
-		return inode_get_inumber(file_get_inode(f->file));
+		inumber = inode_get_inumber(file_get_inode(f->file));
+	process_put_file(f);
+	return inumber;
 }
-void check_write_permission (struct sup_page_entry *spte)
+static unsigned child_hash (const struct hash_elem *e, void *aux UNUSED)
 {
-  if (!spte->writable)
-    {
-      exit(ERROR);
-    }
+  const struct child_process *cp = hash_entry(e, struct child_process, elem);
+  return hash_int(cp->pid);
 }
 
-struct sup_page_entry* check_valid_ptr(const void *vaddr, void* esp)
+static bool child_less (const struct hash_elem *a, const struct hash_elem *b,
+			void *aux UNUSED)
 {
-  if (!is_user_vaddr(vaddr) || vaddr < USER_VADDR_BOTTOM)
-    {
-      exit(ERROR);
-    }
-  bool load = false;
-  struct sup_page_entry *spte = get_spte((void *) vaddr);
-  if (spte)
+  return (hash_entry(a, struct child_process, elem)->pid
+	  < hash_entry(b, struct child_process, elem)->pid);
+}
+
+// Looks up PID in the current process's children. Caller holds
+// child_lock.
+static struct child_process* find_child (int pid)
+{
+  struct thread *t = thread_current();
+  struct child_process key;
+  struct hash_elem *e;
+
+  if (!t->children_ready)
     {
-      load_page(spte);
-      load = spte->is_loaded;
+      return NULL;
     }
-  else if (vaddr >= esp - STACK_HEURISTIC)
+  key.pid = pid;
+  e = hash_find(&t->children, &key.elem);
+  return e ? hash_entry(e, struct child_process, elem) : NULL;
+}
+
+// Forgets CP, which the current process will never reap: a child
+// still running stops reporting to it, one that already exited is
+// taken off the exited list. Caller holds child_lock.
+static void detach_child (struct child_process *cp)
+{
+  if (cp->exit)
     {
-      load = grow_stack((void *) vaddr);
+      list_remove(&cp->exit_elem);
     }
-  if (!load)
+  else
     {
-      exit(ERROR);
+      struct thread *child = thread_get(cp->pid);
+      if (child && child->cp == cp)
+	{
+	  child->cp = NULL;
+	}
     }
-  return spte;
 }
 
-struct child_process* add_child_process (int pid)
+static void free_child (struct hash_elem *e, void *aux UNUSED)
+{
+  struct child_process *cp = hash_entry(e, struct child_process, elem);
+  detach_child(cp);
+  free(cp);
+}
+
+// Runs from thread_init(), before any thread other than the
+// initial one exists.
+void child_init (void)
 {
+  lock_init(&child_lock);
+}
+
+// Returns a new record for a child process that the current thread
+// is about to create, or NULL if memory is short. The child reports
+// to it once it sets its cp to it, and the current thread enters it
+// in its children with add_child_process() once the child's pid is
+// known, which may be after the child has exited.
+struct child_process* new_child_process (void)
+{
+  struct thread *t = thread_current();
   struct child_process* cp = malloc(sizeof(struct child_process));
   if (!cp)
     {
       return NULL;
     }
-  cp->pid = pid;
+  cp->pid = TID_ERROR;
   cp->load = NOT_LOADED;
   cp->wait = false;
   cp->exit = false;
+  cp->status = ERROR;
+  memset(&cp->rusage, 0, sizeof cp->rusage);
   sema_init(&cp->load_sema, 0);
-  sema_init(&cp->exit_sema, 0);
-  list_push_back(&thread_current()->child_list,
-		 &cp->elem);
+
+  lock_acquire(&child_lock);
+  if (!t->children_ready)
+    {
+      t->children_ready = hash_init(&t->children, child_hash, child_less,
+				    NULL);
+    }
+  lock_release(&child_lock);
+  if (!t->children_ready)
+    {
+      free(cp);
+      return NULL;
+    }
   return cp;
 }
 
+// Enters CP, from new_child_process(), in the current thread's
+// children as the record of child PID.
+void add_child_process (struct child_process *cp, int pid)
+{
+  lock_acquire(&child_lock);
+  cp->pid = pid;
+  hash_insert(&thread_current()->children, &cp->elem);
+  lock_release(&child_lock);
+}
+
 struct child_process* get_child_process (int pid)
 {
-  struct thread *t = thread_current();
-  struct list_elem *e;
+  struct child_process *cp;
 
-  for (e = list_begin (&t->child_list); e != list_end (&t->child_list);
-       e = list_next (e))
-        {
-          struct child_process *cp = list_entry (e, struct child_process, elem);
-          if (pid == cp->pid)
-	    {
-	      return cp;
-	    }
-        }
-  return NULL;
+  lock_acquire(&child_lock);
+  cp = find_child(pid);
+  lock_release(&child_lock);
+  return cp;
 }
 
 void remove_child_process (struct child_process *cp)
 {
-  list_remove(&cp->elem);
+  lock_acquire(&child_lock);
+  detach_child(cp);
+  hash_delete(&thread_current()->children, &cp->elem);
+  lock_release(&child_lock);
   free(cp);
 }
 
 void remove_child_processes (void)
 {
   struct thread *t = thread_current();
-  struct list_elem *next, *e = list_begin(&t->child_list);
 
-  while (e != list_end (&t->child_list))
+  lock_acquire(&child_lock);
+  if (t->children_ready)
     {
-      next = list_next(e);
-      struct child_process *cp = list_entry (e, struct child_process,
-					     elem);
-      list_remove(&cp->elem);
-      free(cp);
-      e = next;
+      hash_destroy(&t->children, free_child);
+      t->children_ready = false;
     }
+  lock_release(&child_lock);
 }
 
-void get_arg (struct intr_frame *f, int *arg, int n)
+// Reports the current process's exit, with resource usage USAGE,
+// to its parent and wakes the parent if it is waiting. A non-null
+// cp means the parent has not exited: it would have cleared it.
+void child_process_exit (const struct rusage *usage)
 {
-  int i;
-  int *ptr;
-  for (i = 0; i < n; i++)
+  struct thread *t = thread_current();
+
+  lock_acquire(&child_lock);
+  if (t->cp)
     {
-      ptr = (int *) f->esp + i + 1;
-      check_valid_ptr((const void *) ptr, f->esp);
-      arg[i] = *ptr;
+      struct thread *parent = thread_get(t->parent);
+      ASSERT(parent != NULL);
+      t->cp->rusage = *usage;
+      t->cp->exit = true;
+      list_push_back(&parent->exited_children, &t->cp->exit_elem);
+      cond_broadcast(&parent->child_exited, &child_lock);
+      t->cp = NULL;
     }
+  lock_release(&child_lock);
 }
 
-void check_valid_buffer (void* buffer, unsigned size, void* esp,
-			 bool to_write)
+// Waits for the child PID, or for any child if ANY, to exit and
+// reaps it: stores its exit status in *STATUS, adds its usage to
+// the current process's children total and frees its record.
+// Returns the pid reaped, or ERROR if PID is not a child, is
+// already being waited for, or if ANY and there are no children.
+int reap_child_process (int pid, bool any, int *status)
 {
-  unsigned i;
-  char* local_buffer = (char *) buffer;
-  for (i = 0; i < size; i++)
+  struct thread *t = thread_current();
+  struct child_process *cp;
+
+  lock_acquire(&child_lock);
+  if (any)
     {
-      struct sup_page_entry *spte = check_valid_ptr((const void*)
-						    local_buffer, esp);
-      if (spte && to_write)
+      while (list_empty(&t->exited_children))
 	{
-	  if (!spte->writable)
+	  if (!t->children_ready || hash_empty(&t->children))
 	    {
-	      exit(ERROR);
+	      lock_release(&child_lock);
+	      return ERROR;
 	    }
+	  cond_wait(&t->child_exited, &child_lock);
 	}
-      local_buffer++;
+      cp = list_entry(list_front(&t->exited_children),
+		      struct child_process, exit_elem);
     }
-}
-
-void check_valid_string (const void* str, void* esp)
-{
-  check_valid_ptr(str, esp);
-  while (* (char *) str != 0)
+  else
     {
-      str = (char *) str + 1;
-      check_valid_ptr(str, esp);
+      cp = find_child(pid);
+      if (!cp || cp->wait)
+	{
+	  lock_release(&child_lock);
+	  return ERROR;
+	}
+      cp->wait = true;
+      while (!cp->exit)
+	{
+	  cond_wait(&t->child_exited, &child_lock);
+	}
     }
-}
+  list_remove(&cp->exit_elem);
+  hash_delete(&t->children, &cp->elem);
+  lock_release(&child_lock);
 
-void unpin_ptr (void* vaddr)
-{
-  struct sup_page_entry *spte = get_spte(vaddr);
-  if (spte)
-    {
-      spte->pinned = false;
-    }
+  pid = cp->pid;
+  *status = cp->status;
+  rusage_add(&t->child_rusage, &cp->rusage);
+  free(cp);
+  return pid;
 }
 
-void unpin_string (void* str)
+/* Copies the string at user address USTR into a new page and
+   returns it, terminating the process if USTR is a bad pointer
+   or the string does not fit in a page.  The caller must free
+   the page with palloc_free_page(). */
+static char *copy_in_string (const char *ustr)
 {
-  unpin_ptr(str);
-  while (* (char *) str != 0)
+  char *kstr = palloc_get_page(0);
+  if (!kstr)
     {
-      str = (char *) str + 1;
-      unpin_ptr(str);
+      exit(ERROR);
     }
-}
-
-void unpin_buffer (void* buffer, unsigned size)
-{
-  unsigned i;
-  char* local_buffer = (char *) buffer;
-  for (i = 0; i < size; i++)
+  if (strncpy_from_user(kstr, ustr, PGSIZE) < 0)
     {
-      unpin_ptr(local_buffer);
-      local_buffer++;
+      palloc_free_page(kstr);
+      exit(ERROR);
     }
+  return kstr;
 }
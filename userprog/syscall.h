@@ -1,6 +1,8 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <hash.h>
+#include <rusage.h>
 #include "threads/synch.h"
 
 #define CLOSE_ALL -1
@@ -13,26 +15,35 @@
 #define USER_VADDR_BOTTOM ((void *) 0x08048000)
 #define STACK_HEURISTIC 32
 
-struct lock filesys_lock;
-
 struct child_process {
   int pid;
   int load;
   bool wait;
   bool exit;
   int status;
+  struct rusage rusage;		// Usage, with its children's, at exit
   struct semaphore load_sema;
-  struct semaphore exit_sema;
-  struct list_elem elem;
+  struct hash_elem elem;	// In parent's children table
+  struct list_elem exit_elem;	// In parent's exited_children, once exited
 };
 
-struct child_process* add_child_process (int pid);
+void child_init (void);
+struct child_process* new_child_process (void);
+void add_child_process (struct child_process *cp, int pid);
 struct child_process* get_child_process (int pid);
 void remove_child_process (struct child_process *cp);
 void remove_child_processes (void);
+void child_process_exit (const struct rusage *usage);
+int reap_child_process (int pid, bool any, int *status);
 
 void process_close_file (int fd);
 
+/* -sysstats: Print system call statistics at process exit and
+   at shutdown? */
+extern bool syscall_print_stats_enabled;
+
 void syscall_init (void);
+void syscall_exit_stats (void);
+void syscall_print_stats (void);
 
 #endif /* userprog/syscall.h */
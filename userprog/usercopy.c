@@ -0,0 +1,133 @@
+#include "userprog/usercopy.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Copying to and from user memory.
+
+   The routines below touch user memory without checking first
+   whether it is mapped.  If it is not, the access page faults,
+   and page_fault() tries to bring the page in as usual.  If that
+   is impossible because the address is bad, page_fault() calls
+   usercopy_fixup(), which looks the faulting instruction up in
+   the fixup table, sets %eax to -1 and resumes execution at the
+   corresponding fixup address, from where the routine reports
+   failure to its caller.  The common case thus costs no more than
+   an ordinary memory copy. */
+
+/* Labels defined in the assembly below. */
+extern const char copy_user_insn[], copy_user_fixup[];
+extern const char strncpy_user_insn[], strncpy_user_fixup[];
+
+/* An instruction that may fault on a user address and the place
+   to resume if it does. */
+struct fixup
+  {
+    const void *insn;
+    const void *fixup;
+  };
+
+static const struct fixup fixups[] =
+  {
+    {copy_user_insn, copy_user_fixup},
+    {strncpy_user_insn, strncpy_user_fixup},
+  };
+
+/* Copies SIZE bytes from SRC to DST, either of which may be in
+   user memory.  Returns true if successful, false if it
+   faulted. */
+static bool NO_INLINE __attribute__ ((noclone))
+copy_user (void *dst, const void *src, size_t size)
+{
+  int fault = 0;
+
+  asm volatile ("copy_user_insn: rep movsb\n"
+                "copy_user_fixup:"
+                : "+D" (dst), "+S" (src), "+c" (size), "+a" (fault)
+                : : "memory");
+  return fault == 0;
+}
+
+/* Copies the null-terminated string at user address SRC into
+   DST, which has room for SIZE > 0 bytes.  Returns the string's
+   length, or -1 if it faulted or did not fit. */
+static int NO_INLINE __attribute__ ((noclone))
+strncpy_user (char *dst, const char *src, size_t size)
+{
+  size_t left = size;
+  int last = 0;
+
+  asm volatile ("1:\n"
+                "strncpy_user_insn: lodsb\n"
+                "  stosb\n"
+                "  testb %%al, %%al\n"
+                "  loopnz 1b\n"
+                "strncpy_user_fixup:"
+                : "+D" (dst), "+S" (src), "+c" (left), "+a" (last)
+                : : "cc", "memory");
+  if (last == -1 || (last & 0xff) != 0)
+    return -1;
+  return size - left - 1;
+}
+
+/* Returns true if the SIZE bytes starting at UADDR all lie in
+   user memory. */
+static bool
+is_user_range (const void *uaddr, size_t size)
+{
+  uintptr_t start = (uintptr_t) uaddr;
+  return start + size >= start && start + size <= (uintptr_t) PHYS_BASE;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Returns true if successful, false if USRC is not a valid
+   user buffer. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  return is_user_range (usrc, size) && copy_user (dst, usrc, size);
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Returns true if successful, false if UDST is not a
+   valid, writable user buffer. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  return is_user_range (udst, size) && copy_user (udst, src, size);
+}
+
+/* Copies the null-terminated string at user address USRC into
+   DST, which has room for SIZE bytes including the terminator.
+   Returns the length of the string, or -1 if USRC is not a
+   valid user string or the string does not fit. */
+int
+strncpy_from_user (char *dst, const char *usrc, size_t size)
+{
+  size_t user_left;
+
+  if (!is_user_vaddr (usrc) || size == 0)
+    return -1;
+  user_left = (const char *) PHYS_BASE - usrc;
+  return strncpy_user (dst, usrc, size < user_left ? size : user_left);
+}
+
+/* Called by the page fault handler for a fault in kernel mode
+   that it could not resolve.  If F's instruction is one of the
+   user memory accesses above, arranges for it to fail gracefully
+   and returns true.  Otherwise, returns false. */
+bool
+usercopy_fixup (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof fixups / sizeof *fixups; i++)
+    if ((const void *) f->eip == fixups[i].insn)
+      {
+        f->eip = (void (*) (void)) fixups[i].fixup;
+        f->eax = -1;
+        return true;
+      }
+  return false;
+}
@@ -0,0 +1,15 @@
+#ifndef USERPROG_USERCOPY_H
+#define USERPROG_USERCOPY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct intr_frame;
+
+bool copy_from_user (void *dst, const void *usrc, size_t size);
+bool copy_to_user (void *udst, const void *src, size_t size);
+int strncpy_from_user (char *dst, const char *usrc, size_t size);
+
+bool usercopy_fixup (struct intr_frame *);
+
+#endif /* userprog/usercopy.h */
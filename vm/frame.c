@@ -1,12 +1,16 @@
+#include <string.h>
 #include "filesys/file.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "userprog/pagedir.h"
+#include "userprog/process.h"
 #include "userprog/syscall.h"
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/share.h"
 #include "vm/swap.h"
 
 void frame_table_init (void)
@@ -28,38 +32,116 @@ void* frame_alloc (enum palloc_flags flags, struct sup_page_entry *spte)
     }
   else
     {
-      while (!frame)
-	{
-	  frame = frame_evict(flags);
-	  lock_release(&frame_table_lock);
-	}
+      frame = frame_evict(flags);
+      lock_release(&frame_table_lock);
       if (!frame)
 	{
-	  PANIC ("Frame could not be evicted because swap is full!");
+	  return NULL;
 	}
       frame_add_to_table(frame, spte);
     }
   return frame;
 }
 
+// Adds DELTA to the number of frames T has resident, keeping track
+// of the peak.  The caller must hold frame_table_lock.
+void frame_count (struct thread *t, int delta)
+{
+  t->frame_cnt += delta;
+  if (t->frame_cnt > t->rusage.maxrss)
+    {
+      t->rusage.maxrss = t->frame_cnt;
+    }
+}
+
 void frame_free (void *frame)
 {
-  struct list_elem *e;
-  
   lock_acquire(&frame_table_lock);
+  frame_free_locked(frame);
+  lock_release(&frame_table_lock);
+}
+
+// Returns the frame table entry for FRAME, or NULL.  The caller must
+// hold frame_table_lock.
+static struct frame_entry *frame_lookup (void *frame)
+{
+  struct list_elem *e;
+
   for (e = list_begin(&frame_table); e != list_end(&frame_table);
        e = list_next(e))
     {
       struct frame_entry *fte = list_entry(e, struct frame_entry, elem);
       if (fte->frame == frame)
 	{
-	  list_remove(e);
-	  free(fte);
-	  palloc_free_page(frame);
-	  break;
+	  return fte;
 	}
     }
-  lock_release(&frame_table_lock);
+  return NULL;
+}
+
+// Drops SPTE's reference to FTE, a copy-on-write frame.  The last
+// process left mapping it becomes its owner.  The caller must hold
+// frame_table_lock.
+static void frame_cow_drop (struct frame_entry *fte,
+			    struct sup_page_entry *spte)
+{
+  list_remove(&spte->share_elem);
+  if (--fte->ref_cnt == 1)
+    {
+      struct list_elem *e = list_pop_front(&fte->cow_users);
+      struct sup_page_entry *last = list_entry(e, struct sup_page_entry,
+					       share_elem);
+      fte->spte = last;
+      fte->thread = last->thread;
+    }
+}
+
+// Like frame_free(), for a caller that holds frame_table_lock.
+// A frame still mapped copy-on-write by another process is not
+// freed; only the current process's reference to it is dropped.
+void frame_free_locked (void *frame)
+{
+  struct frame_entry *fte = frame_lookup(frame);
+  if (fte && fte->ref_cnt > 1)
+    {
+      struct list_elem *e;
+      for (e = list_begin(&fte->cow_users); e != list_end(&fte->cow_users);
+	   e = list_next(e))
+	{
+	  struct sup_page_entry *spte = list_entry(e, struct sup_page_entry,
+						   share_elem);
+	  if (spte->thread == process_current())
+	    {
+	      frame_cow_drop(fte, spte);
+	      frame_count(spte->thread, -1);
+	      break;
+	    }
+	}
+    }
+  else if (fte)
+    {
+      if (!fte->share)
+	{
+	  frame_count(fte->thread, -1);
+	}
+      list_remove(&fte->elem);
+      free(fte);
+      palloc_free_page(frame);
+    }
+}
+
+// Hands FRAME over to shared page SHARE, which from now on decides
+// when it can be evicted.  The caller must hold frame_table_lock.
+void frame_set_share (void *frame, struct share_entry *share)
+{
+  struct frame_entry *fte = frame_lookup(frame);
+  if (fte)
+    {
+      // Each process that maps it counts it from now on.
+      frame_count(fte->thread, -1);
+      fte->spte = NULL;
+      fte->share = share;
+    }
 }
 
 void frame_add_to_table (void *frame, struct sup_page_entry *spte)
@@ -67,21 +149,179 @@ void frame_add_to_table (void *frame, struct sup_page_entry *spte)
   struct frame_entry *fte = malloc(sizeof(struct frame_entry));
   fte->frame = frame;
   fte->spte = spte;
-  fte->thread = thread_current();
+  fte->thread = process_current();
+  fte->share = NULL;
+  fte->ref_cnt = 1;
+  list_init(&fte->cow_users);
   lock_acquire(&frame_table_lock);
   list_push_back(&frame_table, &fte->elem);
+  frame_count(fte->thread, 1);
+  lock_release(&frame_table_lock);
+}
+
+// Maps the frame of PSPTE, a resident private page of PARENT, into
+// the current process at SPTE copy-on-write: both mappings become
+// read-only and the frame gains a reference.  The page's contents
+// no longer come from its file, so both sptes become SWAP pages.
+// The caller must hold frame_table_lock.
+bool frame_share_cow (struct thread *parent, struct sup_page_entry *pspte,
+		      struct sup_page_entry *spte)
+{
+  void *frame = pagedir_get_page(parent->pagedir, pspte->uva);
+  struct frame_entry *fte = frame_lookup(frame);
+  if (!fte || !install_page(spte->uva, frame, false))
+    {
+      return false;
+    }
+  if (fte->ref_cnt == 1)
+    {
+      pspte->thread = parent;
+      list_push_back(&fte->cow_users, &pspte->share_elem);
+      pagedir_set_writable(parent->pagedir, pspte->uva, false);
+    }
+  spte->thread = process_current();
+  list_push_back(&fte->cow_users, &spte->share_elem);
+  fte->ref_cnt++;
+  frame_count(spte->thread, 1);
+  pspte->type = spte->type = SWAP;
+  spte->is_loaded = true;
+  return true;
+}
+
+// Handles a write by the current process to SPTE, a writable page
+// mapped read-only because it was shared copy-on-write by fork().
+// Gives the process its own copy of the frame, or, if no other
+// process maps it any more, just makes the mapping writable.
+// Pins SPTE; the caller unpins it.
+bool frame_cow_break (struct sup_page_entry *spte)
+{
+  uint32_t *pd = thread_current()->pagedir;
+  struct frame_entry *fte;
+  void *frame;
+
+  spte->pinned = true;
+  lock_acquire(&frame_table_lock);
+  if (!spte->is_loaded)
+    {
+      // Evicted since the fault; it comes back in writable.
+      lock_release(&frame_table_lock);
+      return load_page(spte);
+    }
+  frame = pagedir_get_page(pd, spte->uva);
+  fte = frame_lookup(frame);
+  if (!fte || fte->share)
+    {
+      lock_release(&frame_table_lock);
+      return false;
+    }
+  if (fte->ref_cnt > 1)
+    {
+      void *copy;
+
+      // SPTE is pinned and holds a reference, so the frame cannot be
+      // evicted or freed while the lock is dropped.
+      lock_release(&frame_table_lock);
+      copy = frame_alloc(PAL_USER, spte);
+      if (!copy)
+	{
+	  return false;
+	}
+      lock_acquire(&frame_table_lock);
+      if (fte->ref_cnt > 1)
+	{
+	  memcpy(copy, frame, PGSIZE);
+	  frame_cow_drop(fte, spte);
+	  frame_count(spte->thread, -1);
+	  pagedir_clear_page(pd, spte->uva);
+	  pagedir_set_page(pd, spte->uva, copy, true);
+	  lock_release(&frame_table_lock);
+	  return true;
+	}
+      // The others let go in the meantime.
+      frame_free_locked(copy);
+    }
+  pagedir_set_writable(pd, spte->uva, true);
   lock_release(&frame_table_lock);
+  return true;
 }
 
+// Tries to evict FTE, a frame shared copy-on-write, for
+// frame_evict().  If no process that maps it has it pinned or has
+// accessed it since the last try, writes it to one swap slot that
+// every such process keeps a reference to, unmaps it from all of
+// them, and returns true; otherwise clears the accessed bits and
+// returns false.
+static bool frame_cow_evict (struct frame_entry *fte)
+{
+  bool accessed = false;
+  struct list_elem *e;
+  size_t swap_index;
+
+  for (e = list_begin(&fte->cow_users); e != list_end(&fte->cow_users);
+       e = list_next(e))
+    {
+      struct sup_page_entry *spte = list_entry(e, struct sup_page_entry,
+					       share_elem);
+      if (spte->pinned)
+	{
+	  return false;
+	}
+      if (pagedir_is_accessed(spte->thread->pagedir, spte->uva))
+	{
+	  pagedir_set_accessed(spte->thread->pagedir, spte->uva, false);
+	  accessed = true;
+	}
+    }
+  if (accessed)
+    {
+      return false;
+    }
+
+  swap_index = swap_out(fte->frame);
+  fte->thread->rusage.swapouts++;
+  while (!list_empty(&fte->cow_users))
+    {
+      e = list_pop_front(&fte->cow_users);
+      struct sup_page_entry *spte = list_entry(e, struct sup_page_entry,
+					       share_elem);
+      if (--fte->ref_cnt > 0)
+	{
+	  swap_share(swap_index);
+	}
+      spte->swap_index = swap_index;
+      spte->is_loaded = false;
+      pagedir_clear_page(spte->thread->pagedir, spte->uva);
+      frame_count(spte->thread, -1);
+    }
+  return true;
+}
+
+// Evicts a frame by the clock algorithm and returns a free page
+// allocated with FLAGS in its place, with frame_table_lock held.
+// Frames that are pinned or mapped by a process that is loading a
+// page are passed over.  Returns NULL if two full sweeps, enough to
+// clear every accessed bit and come back around, find nothing to
+// evict.
 void* frame_evict (enum palloc_flags flags)
 {
   lock_acquire(&frame_table_lock);
   struct list_elem *e = list_begin(&frame_table);
+  size_t left = 2 * list_size(&frame_table);
   
-  while (true)
+  while (left-- > 0 && e != list_end(&frame_table))
     {
       struct frame_entry *fte = list_entry(e, struct frame_entry, elem);
-      if (!fte->spte->pinned)
+      bool evicted = false;
+
+      if (fte->share)
+	{
+	  evicted = share_evict(fte);
+	}
+      else if (fte->ref_cnt > 1)
+	{
+	  evicted = frame_cow_evict(fte);
+	}
+      else if (!fte->spte->pinned)
 	{
 	  struct thread *t = fte->thread;
 	  if (pagedir_is_accessed(t->pagedir, fte->spte->uva))
@@ -95,25 +335,39 @@ void* frame_evict (enum palloc_flags flags)
 		{
 		  if (fte->spte->type == MMAP)
 		    {
-		      lock_acquire(&filesys_lock);
 		      file_write_at(fte->spte->file, fte->frame,
 				    fte->spte->read_bytes,
 				    fte->spte->offset);
-		      lock_release(&filesys_lock);
 		    }
 		  else
 		    {
 		      fte->spte->type = SWAP;
 		      fte->spte->swap_index = swap_out(fte->frame);
+		      t->rusage.swapouts++;
 		    }
 		}
 	      fte->spte->is_loaded = false;
-	      list_remove(&fte->elem);
+	      frame_count(t, -1);
 	      pagedir_clear_page(t->pagedir, fte->spte->uva);
-	      palloc_free_page(fte->frame);
-	      free(fte);
-	      return palloc_get_page(flags);
+	      evicted = true;
+	    }
+	}
+
+      if (evicted)
+	{
+	  void *frame;
+
+	  list_remove(&fte->elem);
+	  palloc_free_page(fte->frame);
+	  free(fte);
+	  frame = palloc_get_page(flags);
+	  if (frame)
+	    {
+	      return frame;
 	    }
+	  // A thread allocating outside the lock took the page first.
+	  e = list_begin(&frame_table);
+	  continue;
 	}
       e = list_next(e);
       if (e == list_end(&frame_table))
@@ -121,4 +375,5 @@ void* frame_evict (enum palloc_flags flags)
 	  e = list_begin(&frame_table);
 	}
     }
+  return NULL;
 }
@@ -16,13 +16,22 @@ struct frame_entry {
   void *frame;
   struct sup_page_entry *spte;
   struct thread *thread;
+  struct share_entry *share;	// Shared page, or NULL if private
+  int ref_cnt;			// Number of processes mapping the frame
+  struct list cow_users;	// Sptes mapping it copy-on-write, if > 1
   struct list_elem elem;
 };
 
 void frame_table_init (void);
 void* frame_alloc (enum palloc_flags flags, struct sup_page_entry *spte);
+void frame_count (struct thread *t, int delta);
 void frame_free (void *frame);
+void frame_free_locked (void *frame);
+void frame_set_share (void *frame, struct share_entry *share);
 void frame_add_to_table (void *frame, struct sup_page_entry *spte);
+bool frame_share_cow (struct thread *parent, struct sup_page_entry *pspte,
+		      struct sup_page_entry *spte);
+bool frame_cow_break (struct sup_page_entry *spte);
 void* frame_evict (enum palloc_flags flags);
 
 #endif /* vm/frame.h */
@@ -11,6 +11,7 @@
 #include "userprog/syscall.h"
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/share.h"
 #include "vm/swap.h"
 
 static unsigned page_hash_func (const struct hash_elem *e, void *aux UNUSED)
@@ -33,15 +34,36 @@ static bool page_less_func (const struct hash_elem *a,
   return false;
 }
 
-static void page_action_func (struct hash_elem *e, void *aux UNUSED)
+// Frees whatever holds SPTE's contents: its place in a shared page,
+// its frame, or its swap slot.  Eviction runs under
+// frame_table_lock, so checking is_loaded under it tells which.
+static void page_release (struct sup_page_entry *spte)
 {
-  struct sup_page_entry *spte = hash_entry(e, struct sup_page_entry,
-					   elem);
+  uint32_t *pd = thread_current()->pagedir;
+
+  if (spte->share)
+    {
+      share_remove(spte);
+      return;
+    }
+  lock_acquire(&frame_table_lock);
   if (spte->is_loaded)
     {
-      frame_free(pagedir_get_page(thread_current()->pagedir, spte->uva));
-      pagedir_clear_page(thread_current()->pagedir, spte->uva);
+      frame_free_locked(pagedir_get_page(pd, spte->uva));
+      pagedir_clear_page(pd, spte->uva);
+    }
+  else if (spte->type == SWAP)
+    {
+      swap_free(spte->swap_index);
     }
+  lock_release(&frame_table_lock);
+}
+
+static void page_action_func (struct hash_elem *e, void *aux UNUSED)
+{
+  struct sup_page_entry *spte = hash_entry(e, struct sup_page_entry,
+					   elem);
+  page_release(spte);
   free(spte);
 }
 
@@ -60,7 +82,7 @@ struct sup_page_entry* get_spte (void *uva)
   struct sup_page_entry spte;
   spte.uva = pg_round_down(uva);
 
-  struct hash_elem *e = hash_find(&thread_current()->spt, &spte.elem);
+  struct hash_elem *e = hash_find(&process_current()->spt, &spte.elem);
   if (!e)
     {
       return NULL;
@@ -68,6 +90,120 @@ struct sup_page_entry* get_spte (void *uva)
   return hash_entry (e, struct sup_page_entry, elem);
 }
 
+// Loads SPTE, a private FILE page, together with as many of the
+// CNT - 1 pages after it as continue it in the file.  Leaves SPTE
+// pinned, like load_page().  Returns the number of pages loaded, 0
+// on failure.
+static size_t load_file_run (struct sup_page_entry *spte, size_t cnt)
+{
+  struct sup_page_entry *run[PAGE_RUN_MAX];
+  uint8_t *frames[PAGE_RUN_MAX];
+  size_t n, i, read_cnt, loaded;
+
+  if (spte->read_bytes == 0)
+    {
+      return load_file(spte) ? 1 : 0;
+    }
+
+  run[0] = spte;
+  for (n = 1; n < cnt && n < PAGE_RUN_MAX; n++)
+    {
+      struct sup_page_entry *prev = run[n - 1];
+      struct sup_page_entry *next = get_spte(prev->uva + PGSIZE);
+      if (prev->read_bytes != PGSIZE || !next || next->type != FILE
+	  || next->share || next->is_loaded || next->file != spte->file
+	  || next->read_bytes == 0 || next->offset != prev->offset + PGSIZE)
+	{
+	  break;
+	}
+      run[n] = next;
+    }
+
+  // Read each page through the frame's kernel address and map it
+  // only when it is complete, with its final permissions, so that
+  // another thread of the process can neither see a page half read
+  // nor write to read-only text.  Pinning keeps the frames resident
+  // until then.
+  for (read_cnt = 0; read_cnt < n; read_cnt++)
+    {
+      struct sup_page_entry *p = run[read_cnt];
+      uint8_t *frame;
+
+      p->pinned = true;
+      frame = frame_alloc(PAL_USER, p);
+      if (!frame)
+	{
+	  break;
+	}
+      thread_current()->page_reads++;
+      if ((int) p->read_bytes != file_read_at(p->file, frame, p->read_bytes,
+					      p->offset))
+	{
+	  frame_free(frame);
+	  break;
+	}
+      memset(frame + p->read_bytes, 0, p->zero_bytes);
+      frames[read_cnt] = frame;
+    }
+
+  for (i = 0; i < read_cnt; i++)
+    {
+      if (!install_page(run[i]->uva, frames[i], run[i]->writable))
+	{
+	  break;
+	}
+      run[i]->is_loaded = true;
+      if (i > 0)
+	{
+	  run[i]->pinned = false;
+	}
+    }
+  loaded = i;
+  for (; i < read_cnt; i++)
+    {
+      frame_free(frames[i]);
+      run[i]->pinned = false;
+    }
+  if (read_cnt < n)
+    {
+      run[read_cnt]->pinned = false;
+    }
+  return loaded;
+}
+
+// Loads the first CNT pages from UPAGE on, all in one segment of the
+// current process's executable, before the process faults on them.
+// Stops early, leaving the rest to be loaded on demand, if memory or
+// the file lets it down.
+void page_prefault (uint8_t *upage, size_t cnt)
+{
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      struct sup_page_entry *spte = get_spte(upage + i * PGSIZE);
+      size_t loaded = 1;
+
+      if (spte && !spte->is_loaded)
+	{
+	  if (spte->type == FILE && !spte->share)
+	    {
+	      loaded = load_file_run(spte, cnt - i);
+	    }
+	  else if (!load_page(spte))
+	    {
+	      loaded = 0;
+	    }
+	  spte->pinned = false;
+	  if (loaded == 0)
+	    {
+	      return;
+	    }
+	}
+      i += loaded;
+    }
+}
+
 bool load_page (struct sup_page_entry *spte)
 {
   bool success = false;
@@ -79,7 +215,14 @@ bool load_page (struct sup_page_entry *spte)
   switch (spte->type)
     {
     case FILE:
-      success = load_file(spte);
+      if (spte->share)
+	{
+	  success = share_load(spte);
+	}
+      else
+	{
+	  success = load_file_run(spte, FAULT_AROUND_PAGES) > 0;
+	}
       break;
     case SWAP:
       success = load_swap(spte);
@@ -105,6 +248,8 @@ bool load_swap (struct sup_page_entry *spte)
     }
   swap_in(spte->swap_index, spte->uva);
   spte->is_loaded = true;
+  thread_current()->page_reads++;
+  thread_current()->rusage.swapins++;
   return true;
 }
 
@@ -122,16 +267,14 @@ bool load_file (struct sup_page_entry *spte)
     }
   if (spte->read_bytes > 0)
     {
-      lock_acquire(&filesys_lock);
+      thread_current()->page_reads++;
       if ((int) spte->read_bytes != file_read_at(spte->file, frame,
 						 spte->read_bytes,
 						 spte->offset))
 	{
-	  lock_release(&filesys_lock);
 	  frame_free(frame);
 	  return false;
 	}
-      lock_release(&filesys_lock);
       memset(frame + spte->read_bytes, 0, spte->zero_bytes);
     }
 
@@ -163,8 +306,75 @@ bool add_file_to_page_table (struct file *file, int32_t ofs, uint8_t *upage,
   spte->is_loaded = false;
   spte->type = FILE;
   spte->pinned = false;
+  spte->share = NULL;
+  spte->anon = false;
+
+  if (hash_insert(&process_current()->spt, &spte->elem))
+    {
+      free(spte);
+      return false;
+    }
+
+  // Read-only pages never change, so every process running the same
+  // executable can use one copy.
+  if (!writable)
+    {
+      share_add(spte);
+    }
+  return true;
+}
+
+// Adds a writable page at UPAGE that reads as zeros until it is
+// first touched, for the heap.  It goes to swap if evicted dirty.
+bool add_zero_to_page_table (uint8_t *upage)
+{
+  return add_file_to_page_table(NULL, 0, upage, 0, PGSIZE, true);
+}
+
+// Adds a page of an anonymous mapping at UPAGE to the current
+// process's page table and its list of mappings.  Like a heap page,
+// it is zero-filled when first touched.
+bool add_anon_to_page_table (uint8_t *upage)
+{
+  struct sup_page_entry *spte = malloc(sizeof(struct sup_page_entry));
+  if (!spte)
+    {
+      return false;
+    }
+  spte->file = NULL;
+  spte->offset = 0;
+  spte->uva = upage;
+  spte->read_bytes = 0;
+  spte->zero_bytes = PGSIZE;
+  spte->is_loaded = false;
+  spte->type = FILE;
+  spte->writable = true;
+  spte->pinned = false;
+  spte->share = NULL;
+  spte->anon = true;
 
-  return (hash_insert(&thread_current()->spt, &spte->elem) == NULL);
+  if (!process_add_mmap(spte))
+    {
+      free(spte);
+      return false;
+    }
+  process_current()->anon_pages++;
+
+  if (hash_insert(&process_current()->spt, &spte->elem))
+    {
+      spte->type = HASH_ERROR;
+      return false;
+    }
+  return true;
+}
+
+// Removes SPTE from the current process's page table and frees it
+// and what it holds, discarding its contents.
+void page_remove (struct sup_page_entry *spte)
+{
+  hash_delete(&process_current()->spt, &spte->elem);
+  page_release(spte);
+  free(spte);
 }
 
 bool add_mmap_to_page_table(struct file *file, int32_t ofs, uint8_t *upage,
@@ -184,6 +394,8 @@ bool add_mmap_to_page_table(struct file *file, int32_t ofs, uint8_t *upage,
   spte->type = MMAP;
   spte->writable = true;
   spte->pinned = false;
+  spte->share = NULL;
+  spte->anon = false;
 
   if (!process_add_mmap(spte))
     {
@@ -191,7 +403,7 @@ bool add_mmap_to_page_table(struct file *file, int32_t ofs, uint8_t *upage,
       return false;
     }
 
-  if (hash_insert(&thread_current()->spt, &spte->elem))
+  if (hash_insert(&process_current()->spt, &spte->elem))
     {
       spte->type = HASH_ERROR;
       return false;
@@ -199,6 +411,75 @@ bool add_mmap_to_page_table(struct file *file, int32_t ofs, uint8_t *upage,
   return true;
 }
 
+// Gives the current process, a child created by fork(), its own
+// entry for PSPTE, a page of PARENT.  Resident private pages are
+// shared copy-on-write, shared file pages stay shared, pages still
+// in the executable are loaded from the child's own copy of it on
+// demand, and swapped-out pages share the parent's swap slot until
+// each process reads its copy back in.
+static bool page_copy (struct thread *parent, struct sup_page_entry *pspte)
+{
+  struct thread *t = thread_current();
+  struct sup_page_entry *spte = malloc(sizeof(struct sup_page_entry));
+
+  if (!spte)
+    {
+      return false;
+    }
+  lock_acquire(&frame_table_lock);
+  *spte = *pspte;
+  spte->file = t->executable;
+  spte->is_loaded = false;
+  spte->pinned = false;
+  spte->share = NULL;
+  if (hash_insert(&t->spt, &spte->elem))
+    {
+      lock_release(&frame_table_lock);
+      free(spte);
+      return false;
+    }
+  if (pspte->share)
+    {
+      lock_release(&frame_table_lock);
+      share_add(spte);
+      return true;
+    }
+  if (pspte->is_loaded)
+    {
+      bool success = frame_share_cow(parent, pspte, spte);
+      lock_release(&frame_table_lock);
+      return success;
+    }
+  // fork() holds the parent's vm_lock, so none of its threads can
+  // swap the page back in and free the slot meanwhile.
+  if (spte->type == SWAP)
+    {
+      swap_share(spte->swap_index);
+    }
+  lock_release(&frame_table_lock);
+  return true;
+}
+
+// Copies PARENT's supplemental page table into the current process,
+// a child created by fork() whose page directory is empty.  Memory
+// mappings, file-backed or anonymous, are not inherited.
+bool page_table_copy (struct thread *parent)
+{
+  struct hash_iterator i;
+
+  hash_first(&i, &parent->spt);
+  while (hash_next(&i))
+    {
+      struct sup_page_entry *pspte = hash_entry(hash_cur(&i),
+						struct sup_page_entry, elem);
+      if (pspte->type != MMAP && !pspte->anon && !page_copy(parent, pspte))
+	{
+	  return false;
+	}
+    }
+  return true;
+}
+
 bool grow_stack (void *uva)
 {
   if ( (size_t) (PHYS_BASE - pg_round_down(uva)) > MAX_STACK_SIZE)
@@ -215,6 +496,8 @@ bool grow_stack (void *uva)
   spte->writable = true;
   spte->type = SWAP;
   spte->pinned = true;
+  spte->share = NULL;
+  spte->anon = false;
 
   uint8_t *frame = frame_alloc (PAL_USER, spte);
   if (!frame)
@@ -235,5 +518,5 @@ bool grow_stack (void *uva)
       spte->pinned = false;
     }
 
-  return (hash_insert(&thread_current()->spt, &spte->elem) == NULL);
+  return (hash_insert(&process_current()->spt, &spte->elem) == NULL);
 }
@@ -12,6 +12,24 @@
 // 256 KB
 #define MAX_STACK_SIZE (1 << 23)
 
+// Stacks of the threads made by thread_spawn(): up to
+// THREAD_STACK_SLOTS of THREAD_STACK_SIZE bytes each, just below
+// the area kept for the main stack
+#define THREAD_STACK_SIZE (1 << 18)
+#define THREAD_STACK_SLOTS 16
+#define THREAD_STACKS_BOTTOM \
+  ((uint8_t *) PHYS_BASE - MAX_STACK_SIZE \
+   - THREAD_STACK_SLOTS * THREAD_STACK_SIZE)
+
+// Most pages of anonymous mappings a process may have at once,
+// since each takes kernel memory for its page table entry
+#define ANON_MAX_PAGES 4096
+
+// Most pages loaded from a file at once, and how many pages starting
+// at a faulting page of an executable are loaded together.
+#define PAGE_RUN_MAX 16
+#define FAULT_AROUND_PAGES 8
+
 struct sup_page_entry {
   uint8_t type;
   void *uva;
@@ -19,6 +37,9 @@ struct sup_page_entry {
 
   bool is_loaded;
   bool pinned;
+  // Part of an anonymous mapping: reads as zeros until written,
+  // goes to swap when evicted dirty, and is dropped when unmapped
+  bool anon;
 
   // For files
   struct file *file;
@@ -28,22 +49,33 @@ struct sup_page_entry {
   
   // For swap
   size_t swap_index;
+
+  // For read-only file pages shared with other processes, and for
+  // private pages shared copy-on-write after fork()
+  struct share_entry *share;
+  struct thread *thread;
+  struct list_elem share_elem;
   
   struct hash_elem elem;
 };
 
 void page_table_init (struct hash *spt);
 void page_table_destroy (struct hash *spt);
+bool page_table_copy (struct thread *parent);
 
 bool load_page (struct sup_page_entry *spte);
 bool load_mmap (struct sup_page_entry *spte);
 bool load_swap (struct sup_page_entry *spte);
 bool load_file (struct sup_page_entry *spte);
+void page_prefault (uint8_t *upage, size_t cnt);
 bool add_file_to_page_table (struct file *file, int32_t ofs, uint8_t *upage,
 			     uint32_t read_bytes, uint32_t zero_bytes,
 			     bool writable);
 bool add_mmap_to_page_table(struct file *file, int32_t ofs, uint8_t *upage,
 			    uint32_t read_bytes, uint32_t zero_bytes);
+bool add_zero_to_page_table (uint8_t *upage);
+bool add_anon_to_page_table (uint8_t *upage);
+void page_remove (struct sup_page_entry *spte);
 bool grow_stack (void *uva);
 struct sup_page_entry* get_spte (void *uva);
 
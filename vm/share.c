@@ -0,0 +1,256 @@
+#include "vm/share.h"
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+
+// Read-only file pages, such as program text, are shared by every
+// process that maps the same page of the same inode.  Each one has
+// a share_entry, which holds the frame, if the page is resident,
+// and the list of sptes that map it.  The frame is read in from
+// disk by the first process to fault on the page, mapped read-only
+// into each process that faults on it after that, and dropped on
+// eviction or when the last spte goes away.
+//
+// All of this is guarded by frame_table_lock, since eviction needs
+// it together with the frame table.
+//
+// Each entry holds its inode open, so that the inode cannot be
+// freed, and its address reused by another inode, while the entry
+// is keyed on it.  The inode is opened and closed outside
+// frame_table_lock, which ranks below the file system's locks.
+
+struct share_entry {
+  struct inode *inode;		// Key: inode, held open by the entry
+  off_t offset;			// Key: offset of the page in the inode
+  void *frame;			// Kernel address of the frame, or NULL
+  bool loading;			// True while a process reads the frame in
+  struct condition loaded;	// Signaled when loading becomes false
+  struct list users;		// Sptes that map the page
+  struct hash_elem elem;
+};
+
+static struct hash share_table;
+
+static unsigned share_hash_func (const struct hash_elem *e,
+				 void *aux UNUSED)
+{
+  struct share_entry *se = hash_entry(e, struct share_entry, elem);
+  return hash_bytes(&se->inode, sizeof se->inode) ^ hash_int(se->offset);
+}
+
+static bool share_less_func (const struct hash_elem *a,
+			     const struct hash_elem *b,
+			     void *aux UNUSED)
+{
+  struct share_entry *sa = hash_entry(a, struct share_entry, elem);
+  struct share_entry *sb = hash_entry(b, struct share_entry, elem);
+  if (sa->inode != sb->inode)
+    {
+      return sa->inode < sb->inode;
+    }
+  return sa->offset < sb->offset;
+}
+
+void share_init (void)
+{
+  hash_init(&share_table, share_hash_func, share_less_func, NULL);
+}
+
+// Makes SPTE, a read-only FILE page of the current process, use the
+// shared copy of its page.  Returns false if memory is short, in
+// which case SPTE stays private.
+bool share_add (struct sup_page_entry *spte)
+{
+  struct share_entry key;
+  struct share_entry *se;
+  struct hash_elem *e;
+
+  key.inode = inode_reopen(file_get_inode(spte->file));
+  key.offset = spte->offset;
+
+  lock_acquire(&frame_table_lock);
+  e = hash_find(&share_table, &key.elem);
+  if (e)
+    {
+      se = hash_entry(e, struct share_entry, elem);
+    }
+  else
+    {
+      se = malloc(sizeof *se);
+      if (!se)
+	{
+	  lock_release(&frame_table_lock);
+	  inode_close(key.inode);
+	  return false;
+	}
+      se->inode = key.inode;
+      key.inode = NULL;
+      se->offset = key.offset;
+      se->frame = NULL;
+      se->loading = false;
+      cond_init(&se->loaded);
+      list_init(&se->users);
+      hash_insert(&share_table, &se->elem);
+    }
+  list_push_back(&se->users, &spte->share_elem);
+  spte->share = se;
+  spte->thread = process_current();
+  lock_release(&frame_table_lock);
+
+  // Drop the extra reference if the entry already had one.
+  inode_close(key.inode);
+  return true;
+}
+
+// Maps SPTE's shared page into the current process, reading it in
+// first if no process has it resident.
+bool share_load (struct sup_page_entry *spte)
+{
+  struct share_entry *se = spte->share;
+  bool success;
+
+  lock_acquire(&frame_table_lock);
+  while (se->loading)
+    {
+      cond_wait(&se->loaded, &frame_table_lock);
+    }
+  if (!se->frame)
+    {
+      enum palloc_flags flags = PAL_USER;
+      uint8_t *frame;
+
+      se->loading = true;
+      lock_release(&frame_table_lock);
+
+      // SPTE is pinned, so the frame cannot be evicted while it is
+      // being read.
+      if (spte->read_bytes == 0)
+	{
+	  flags |= PAL_ZERO;
+	}
+      frame = frame_alloc(flags, spte);
+      if (frame && spte->read_bytes > 0)
+	{
+	  thread_current()->page_reads++;
+	}
+      if (frame && spte->read_bytes > 0
+	  && (int) spte->read_bytes != file_read_at(spte->file, frame,
+						    spte->read_bytes,
+						    spte->offset))
+	{
+	  frame_free(frame);
+	  frame = NULL;
+	}
+      if (frame)
+	{
+	  memset(frame + spte->read_bytes, 0, spte->zero_bytes);
+	}
+
+      lock_acquire(&frame_table_lock);
+      if (frame)
+	{
+	  frame_set_share(frame, se);
+	}
+      se->frame = frame;
+      se->loading = false;
+      cond_broadcast(&se->loaded, &frame_table_lock);
+      if (!frame)
+	{
+	  lock_release(&frame_table_lock);
+	  return false;
+	}
+    }
+
+  success = install_page(spte->uva, se->frame, false);
+  if (success)
+    {
+      spte->is_loaded = true;
+      frame_count(spte->thread, 1);
+    }
+  lock_release(&frame_table_lock);
+  return success;
+}
+
+// Unmaps SPTE from the current process and drops it from its shared
+// page, which is freed along with its frame if SPTE was the last
+// user.
+void share_remove (struct sup_page_entry *spte)
+{
+  struct share_entry *se = spte->share;
+  struct inode *inode = NULL;
+
+  lock_acquire(&frame_table_lock);
+  if (spte->is_loaded)
+    {
+      pagedir_clear_page(spte->thread->pagedir, spte->uva);
+      spte->is_loaded = false;
+      frame_count(spte->thread, -1);
+    }
+  list_remove(&spte->share_elem);
+  if (list_empty(&se->users) && !se->loading)
+    {
+      if (se->frame)
+	{
+	  frame_free_locked(se->frame);
+	}
+      hash_delete(&share_table, &se->elem);
+      inode = se->inode;
+      free(se);
+    }
+  lock_release(&frame_table_lock);
+  inode_close(inode);
+}
+
+// Tries to evict FTE, the frame of a shared page, for frame_evict(),
+// which holds frame_table_lock.  If no process has accessed the page
+// since the last try, unmaps it from every process and returns true;
+// otherwise clears the accessed bits and returns false.
+bool share_evict (struct frame_entry *fte)
+{
+  struct share_entry *se = fte->share;
+  bool accessed = false;
+  struct list_elem *e;
+
+  if (se->loading)
+    {
+      return false;
+    }
+  for (e = list_begin(&se->users); e != list_end(&se->users);
+       e = list_next(e))
+    {
+      struct sup_page_entry *spte = list_entry(e, struct sup_page_entry,
+					       share_elem);
+      if (spte->is_loaded
+	  && pagedir_is_accessed(spte->thread->pagedir, spte->uva))
+	{
+	  pagedir_set_accessed(spte->thread->pagedir, spte->uva, false);
+	  accessed = true;
+	}
+    }
+  if (accessed)
+    {
+      return false;
+    }
+
+  for (e = list_begin(&se->users); e != list_end(&se->users);
+       e = list_next(e))
+    {
+      struct sup_page_entry *spte = list_entry(e, struct sup_page_entry,
+					       share_elem);
+      if (spte->is_loaded)
+	{
+	  pagedir_clear_page(spte->thread->pagedir, spte->uva);
+	  spte->is_loaded = false;
+	  frame_count(spte->thread, -1);
+	}
+    }
+  se->frame = NULL;
+  return true;
+}
@@ -0,0 +1,14 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <stdbool.h>
+#include "vm/frame.h"
+#include "vm/page.h"
+
+void share_init (void);
+bool share_add (struct sup_page_entry *spte);
+bool share_load (struct sup_page_entry *spte);
+void share_remove (struct sup_page_entry *spte);
+bool share_evict (struct frame_entry *fte);
+
+#endif /* vm/share.h */
@@ -1,4 +1,10 @@
 #include "vm/swap.h"
+#include "threads/malloc.h"
+
+// Number of sptes that refer to each slot in use.  A page shared
+// copy-on-write by several processes is swapped out once, to one
+// slot, which stays in use until the last of them lets go of it.
+static unsigned *swap_refs;
 
 void swap_init (void)
 {
@@ -12,6 +18,13 @@ void swap_init (void)
     {
       return;
     }
+  swap_refs = malloc(bitmap_size(swap_map) * sizeof *swap_refs);
+  if (!swap_refs)
+    {
+      bitmap_destroy(swap_map);
+      swap_map = NULL;
+      return;
+    }
   bitmap_set_all(swap_map, SWAP_FREE);
   lock_init(&swap_lock);
 }
@@ -30,6 +43,7 @@ size_t swap_out (void *frame)
     {
       PANIC("Swap partition is full!");
     }
+  swap_refs[free_index] = 1;
 
   size_t i;
   for (i = 0; i < SECTORS_PER_PAGE; i++)
@@ -52,7 +66,10 @@ void swap_in (size_t used_index, void* frame)
     {
       PANIC ("Trying to swap in a free block! Kernel panicking.");
     }
-  bitmap_flip(swap_map, used_index);
+  if (--swap_refs[used_index] == 0)
+    {
+      bitmap_flip(swap_map, used_index);
+    }
 
   size_t i;
   for (i = 0; i < SECTORS_PER_PAGE; i++)
@@ -62,3 +79,36 @@ void swap_in (size_t used_index, void* frame)
     }
   lock_release(&swap_lock);
 }
+
+// Gives back a slot whose page is no longer needed, without reading
+// it, as when a process drops a page that is swapped out.
+void swap_free (size_t used_index)
+{
+  if (!swap_block || !swap_map)
+    {
+      return;
+    }
+  lock_acquire(&swap_lock);
+  if (bitmap_test(swap_map, used_index) == SWAP_FREE)
+    {
+      PANIC ("Trying to free a free block! Kernel panicking.");
+    }
+  if (--swap_refs[used_index] == 0)
+    {
+      bitmap_flip(swap_map, used_index);
+    }
+  lock_release(&swap_lock);
+}
+
+// Adds a reference to a slot in use, for another spte that is to
+// read the same page back in.
+void swap_share (size_t used_index)
+{
+  lock_acquire(&swap_lock);
+  if (bitmap_test(swap_map, used_index) == SWAP_FREE)
+    {
+      PANIC ("Trying to share a free block! Kernel panicking.");
+    }
+  swap_refs[used_index]++;
+  lock_release(&swap_lock);
+}
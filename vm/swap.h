@@ -20,5 +20,7 @@ struct bitmap *swap_map;
 void swap_init (void);
 size_t swap_out (void *frame);
 void swap_in (size_t used_index, void* frame);
+void swap_share (size_t used_index);
+void swap_free (size_t used_index);
 
 #endif /* vm/swap.h */